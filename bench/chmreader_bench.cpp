@@ -0,0 +1,297 @@
+// chmreader-bench: times the non-GUI stages of opening and searching CHMs
+// over a directory of archives and reports latency percentiles, throughput
+// and peak RSS as JSON.
+
+#include "corpusgenerator.h"
+#include "chmarchive.h"
+#include "htmlcodec.h"
+#include "htmltext.h"
+#include "pagesearch.h"
+#include "tocparser.h"
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+    struct Stage
+    {
+        QVector<double> samplesMs;
+        qint64 bytes = 0;
+    };
+
+    // Stages in the order they run when a CHM is opened and searched
+    const char *const kStageOrder[] = {
+        "unpack", "open", "detectEncoding", "transcode", "tocParse", "stripHtmlTags", "search"
+    };
+
+    double elapsedMs(const QElapsedTimer &timer)
+    {
+        return timer.nsecsElapsed() / 1e6;
+    }
+
+    double percentile(QVector<double> samples, double p)
+    {
+        if (samples.isEmpty()) return 0.0;
+        std::sort(samples.begin(), samples.end());
+        // Nearest-rank percentile
+        int rank = int(std::ceil(p * samples.size()));
+        return samples.at(qBound(0, rank - 1, samples.size() - 1));
+    }
+
+    qint64 peakRssKb()
+    {
+#ifdef Q_OS_UNIX
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef Q_OS_MACOS
+            return usage.ru_maxrss / 1024;  // Bytes on macOS
+#else
+            return usage.ru_maxrss;         // Kilobytes on Linux
+#endif
+        }
+#endif
+        return -1;
+    }
+
+    QStringList pagesBelow(const QString &rootDir)
+    {
+        QStringList pages;
+        QDirIterator it(rootDir, QStringList() << "*.html" << "*.htm", QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            QString path = it.next();
+            if (!ChmArchive::isSystemFile(it.fileName())) {
+                pages << path;
+            }
+        }
+        pages.sort();
+        return pages;
+    }
+
+    // Run every stage once over one unpacked archive
+    void benchArchive(const QString &rootDir, const QStringList &queries, QMap<QString, Stage> &stages)
+    {
+        QElapsedTimer timer;
+
+        // open: what MainWindow::openChm does after unpacking, minus the UI
+        timer.start();
+        QString firstPage = ChmArchive::findFirstPage(rootDir);
+        if (!firstPage.isEmpty()) {
+            HtmlCodec::detectFileEncoding(firstPage);
+        }
+        QString hhcPath = ChmArchive::findToc(rootDir);
+        ChmArchive::findHomePage(rootDir);
+        stages["open"].samplesMs << elapsedMs(timer);
+
+        if (!hhcPath.isEmpty()) {
+            timer.start();
+            QVector<TocEntry> toc = TocParser::parseFile(hhcPath);
+            stages["tocParse"].samplesMs << elapsedMs(timer);
+            stages["tocParse"].bytes += QFileInfo(hhcPath).size();
+            Q_UNUSED(toc);
+        }
+
+        for (const QString &page : pagesBelow(rootDir)) {
+            qint64 size = QFileInfo(page).size();
+
+            timer.start();
+            HtmlCodec::detectFileEncoding(page);
+            stages["detectEncoding"].samplesMs << elapsedMs(timer);
+            stages["detectEncoding"].bytes += qMin<qint64>(size, 8192);
+
+            timer.start();
+            QString html = HtmlCodec::transcodeFile(page);
+            stages["transcode"].samplesMs << elapsedMs(timer);
+            stages["transcode"].bytes += size;
+
+            timer.start();
+            QString text = HtmlText::stripTags(html);
+            stages["stripHtmlTags"].samplesMs << elapsedMs(timer);
+            stages["stripHtmlTags"].bytes += html.size() * qint64(sizeof(QChar));
+            Q_UNUSED(text);
+        }
+
+        // search: cold, without the resource cache, like the first query after opening
+        for (const QString &query : queries) {
+            timer.start();
+            PageSearch::search(rootDir, query);
+            stages["search"].samplesMs << elapsedMs(timer);
+        }
+    }
+
+    QJsonObject stageReport(const Stage &stage)
+    {
+        double totalMs = 0.0;
+        for (double sample : stage.samplesMs) {
+            totalMs += sample;
+        }
+
+        QJsonObject report;
+        report["samples"] = stage.samplesMs.size();
+        report["p50_ms"] = percentile(stage.samplesMs, 0.50);
+        report["p99_ms"] = percentile(stage.samplesMs, 0.99);
+        report["total_ms"] = totalMs;
+        report["ops_per_s"] = totalMs > 0.0 ? stage.samplesMs.size() * 1000.0 / totalMs : 0.0;
+        if (stage.bytes > 0) {
+            report["bytes"] = double(stage.bytes);
+            report["mb_per_s"] = totalMs > 0.0 ? (stage.bytes / (1024.0 * 1024.0)) / (totalMs / 1000.0) : 0.0;
+        }
+        return report;
+    }
+
+    int runGenerate(const QCommandLineParser &parser)
+    {
+        CorpusGenerator::Options options;
+        options.outDir = parser.value("generate");
+        options.encoding = parser.value("encoding").toLatin1();
+        options.archives = parser.value("archives").toInt();
+        options.pages = parser.value("pages").toInt();
+        options.wordsPerPage = parser.value("words").toInt();
+        options.seed = parser.value("seed").toUInt();
+
+        QString error;
+        if (!CorpusGenerator::generate(options, &error)) {
+            QTextStream(stderr) << error << endl;
+            return 1;
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("chmreader-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Time CHM open, TOC parse, text extraction and search without the GUI.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "Directory of .chm files and/or unpacked archive directories.");
+    parser.addOptions({
+        {"iterations", "Number of passes over the input.", "n", "5"},
+        {"query", "Search query to time (repeatable).", "text"},
+        {"output", "Write the JSON report to file instead of stdout.", "file"},
+        {"trace", "Also record a Chrome trace of the run to file.", "file"},
+        {"generate", "Write a synthetic corpus to dir and exit.", "dir"},
+        {"encoding", "Corpus encoding: UTF-8 or GBK.", "name", "UTF-8"},
+        {"archives", "Number of corpus archives to generate.", "n", "1"},
+        {"pages", "Pages per generated archive.", "n", "200"},
+        {"words", "Words per generated page.", "n", "400"},
+        {"seed", "Corpus generator seed.", "n", "1"},
+    });
+    parser.process(app);
+
+    if (parser.isSet("generate")) {
+        return runGenerate(parser);
+    }
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+
+    QDir inputDir(parser.positionalArguments().first());
+    QStringList queries = parser.values("query");
+    if (queries.isEmpty()) {
+        queries << "register" << "interrupt handler" << QString::fromUtf8("中断");
+    }
+    int iterations = qMax(1, parser.value("iterations").toInt());
+
+    // An input that is itself an unpacked archive is benchmarked on its own
+    QStringList archives;
+    if (!ChmArchive::findToc(inputDir.path()).isEmpty() && inputDir.entryList(QStringList() << "*.chm", QDir::Files).isEmpty()) {
+        archives << inputDir.absolutePath();
+    } else {
+        for (const QFileInfo &fi : inputDir.entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name)) {
+            if (fi.isDir() || fi.suffix().compare("chm", Qt::CaseInsensitive) == 0) {
+                archives << fi.absoluteFilePath();
+            }
+        }
+    }
+
+    if (archives.isEmpty()) {
+        QTextStream(stderr) << "No archives found in " << inputDir.path() << endl;
+        return 1;
+    }
+
+    if (parser.isSet("trace")) {
+        Trace::setEnabled(true);
+    }
+
+    QMap<QString, Stage> stages;
+    QElapsedTimer wallTimer;
+    wallTimer.start();
+
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        for (const QString &archive : archives) {
+            if (QFileInfo(archive).isDir()) {
+                benchArchive(archive, queries, stages);
+                continue;
+            }
+
+            QTemporaryDir tmp;
+            QElapsedTimer timer;
+            timer.start();
+            if (!tmp.isValid() || !ChmArchive::unpack(archive, tmp.path())) {
+                QTextStream(stderr) << "Failed to unpack " << archive << endl;
+                return 1;
+            }
+            stages["unpack"].samplesMs << elapsedMs(timer);
+            stages["unpack"].bytes += QFileInfo(archive).size();
+
+            benchArchive(tmp.path(), queries, stages);
+        }
+    }
+
+    if (parser.isSet("trace") && !Trace::writeChromeJson(parser.value("trace"))) {
+        QTextStream(stderr) << "Cannot write " << parser.value("trace") << endl;
+    }
+
+    QJsonObject stageReports;
+    for (const char *name : kStageOrder) {
+        if (stages.contains(name)) {
+            stageReports[name] = stageReport(stages.value(name));
+        }
+    }
+
+    QJsonObject report;
+    report["archives"] = QJsonArray::fromStringList(archives);
+    report["iterations"] = iterations;
+    report["queries"] = QJsonArray::fromStringList(queries);
+    report["stages"] = stageReports;
+    report["wall_ms"] = elapsedMs(wallTimer);
+    report["peak_rss_kb"] = double(peakRssKb());
+
+    QByteArray json = QJsonDocument(report).toJson();
+    if (parser.isSet("output")) {
+        QFile out(parser.value("output"));
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            QTextStream(stderr) << "Cannot write " << out.fileName() << endl;
+            return 1;
+        }
+        out.write(json);
+    } else {
+        QTextStream(stdout) << json;
+    }
+
+    return 0;
+}
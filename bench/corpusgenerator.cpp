@@ -0,0 +1,181 @@
+#include "corpusgenerator.h"
+
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+#include <QTextCodec>
+
+namespace
+{
+    const int kPagesPerChapter = 10;
+
+    // Small LCG so output does not depend on the platform's rand()
+    class Random
+    {
+    public:
+        explicit Random(quint32 seed) : m_state(seed) {}
+
+        int next(int bound)
+        {
+            m_state = m_state * 1664525u + 1013904223u;
+            return int((m_state >> 8) % quint32(bound));
+        }
+
+    private:
+        quint32 m_state;
+    };
+
+    const char *const kEnglishWords[] = {
+        "register", "interrupt", "clock", "driver", "buffer", "channel", "timer", "config",
+        "device", "memory", "handler", "status", "enable", "disable", "mode", "value",
+        "function", "return", "parameter", "structure", "pointer", "address", "transfer", "reset",
+        "peripheral", "callback", "priority", "instance", "initialize", "example", "note", "error"
+    };
+
+    QString chineseWord(Random &random)
+    {
+        // Common characters found in Chinese technical manuals
+        static const QString chars = QString::fromUtf8(
+            "的一是在不了有和人这中大为上个国我以要他时来用们生到作地于出就分对成会可主发年动"
+            "同工也能下过子说产种面而方后多定行学法所民得经十三之进着等部度家电力里如水化高自"
+            "二理起小物现实加量都两体制机当使点从业本去把性好应开它合还因由其些然前外天政四日"
+            "那社义事平形相全表间样与关各重新线内数正心反你明看原又么利比或但质气第向道命此变"
+            "条只没结解问意建月公无系军很情者最立代想已通并提直题党程展五果料象员革位入常文总"
+            "次品式活设及管特件长求老头基资边流路级少图山统接知较将组见计别她手角期根论运农指"
+            "寄存器中断时钟驱动缓冲通道定时配置设备内存处理状态使能模式数值函数返回参数结构指针");
+        QString word;
+        word += chars.at(random.next(chars.size()));
+        word += chars.at(random.next(chars.size()));
+        return word;
+    }
+
+    QString makeWords(Random &random, int count)
+    {
+        const int englishCount = int(sizeof(kEnglishWords) / sizeof(kEnglishWords[0]));
+        QString words;
+        bool lastChinese = false;
+        for (int i = 0; i < count; ++i) {
+            // Chinese text still mixes in English identifiers, as real SDK manuals do;
+            // only runs of Chinese are written without spaces
+            const bool chinese = random.next(3) != 0;
+            if (i > 0 && !(chinese && lastChinese)) {
+                words += ' ';
+            }
+            if (chinese) {
+                words += chineseWord(random);
+            } else {
+                words += QString::fromLatin1(kEnglishWords[random.next(englishCount)]);
+            }
+            lastChinese = chinese;
+        }
+        return words;
+    }
+
+    QString pageName(int index)
+    {
+        return QString("p%1.html").arg(index, 4, 10, QChar('0'));
+    }
+
+    bool writeFile(const QString &path, const QString &content, QTextCodec *codec, QString *error)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            *error = QString("Cannot write %1: %2").arg(path, file.errorString());
+            return false;
+        }
+        file.write(codec->fromUnicode(content));
+        return true;
+    }
+
+    QString tocObject(const QString &name, const QString &local)
+    {
+        return QString("<LI> <OBJECT type=\"text/sitemap\">\n"
+                       "    <param name=\"Name\" value=\"%1\">\n"
+                       "    <param name=\"Local\" value=\"%2\">\n"
+                       "    </OBJECT>\n").arg(name, local);
+    }
+}
+
+bool CorpusGenerator::generate(const Options &options, QString *error)
+{
+    QTextCodec *codec = QTextCodec::codecForName(options.encoding);
+    if (!codec) {
+        *error = QString("Unknown encoding %1").arg(QString::fromLatin1(options.encoding));
+        return false;
+    }
+
+    // The codec's canonical name, so "gbk", "utf8" and aliases name the corpus
+    // and its charset consistently; every encoding gets the same mixed
+    // Chinese and English text, so UTF-8 runs decode multibyte sequences too
+    const QString encoding = QString::fromLatin1(codec->name()).toLower();
+    Random random(options.seed);
+
+    for (int archive = 0; archive < options.archives; ++archive) {
+        QString name = QString("corpus-%1-%2").arg(encoding).arg(archive);
+        QDir root(QDir(options.outDir).filePath(name));
+        if (!root.mkpath("pages")) {
+            *error = QString("Cannot create %1").arg(root.path());
+            return false;
+        }
+
+        QStringList titles;
+        for (int page = 0; page < options.pages; ++page) {
+            titles << makeWords(random, 3);
+        }
+
+        // Pages: a heading, paragraphs of text, and links to the neighbours
+        for (int page = 0; page < options.pages; ++page) {
+            QString body;
+            for (int words = 0; words < options.wordsPerPage; words += 50) {
+                body += "<p>" + makeWords(random, qMin(50, options.wordsPerPage - words)) + "</p>\n";
+            }
+
+            QString links;
+            if (page > 0) links += QString("<a href=\"%1\">Prev</a> ").arg(pageName(page - 1));
+            if (page + 1 < options.pages) links += QString("<a href=\"%1\">Next</a>").arg(pageName(page + 1));
+
+            QString html = QString(
+                "<html>\n<head>\n"
+                "<meta http-equiv=\"Content-Type\" content=\"text/html; charset=%1\">\n"
+                "<title>%2</title>\n"
+                "<style type=\"text/css\">body { font-family: sans-serif; }</style>\n"
+                "<script type=\"text/javascript\">var page = %3;</script>\n"
+                "</head>\n<body>\n<h1>%2</h1>\n%4<p>%5</p>\n</body>\n</html>\n")
+                .arg(encoding, titles.at(page)).arg(page).arg(body, links);
+
+            if (!writeFile(root.filePath("pages/" + pageName(page)), html, codec, error)) {
+                return false;
+            }
+        }
+
+        // Table of contents: one chapter entry per ten pages with the rest nested below it
+        QString hhc = "<!DOCTYPE HTML PUBLIC \"-//IETF//DTD HTML//EN\">\n<HTML>\n<HEAD>\n</HEAD><BODY>\n<UL>\n";
+        for (int page = 0; page < options.pages; page += kPagesPerChapter) {
+            hhc += tocObject(titles.at(page), "pages/" + pageName(page));
+            int last = qMin(options.pages, page + kPagesPerChapter);
+            if (page + 1 < last) {
+                hhc += "<UL>\n";
+                for (int child = page + 1; child < last; ++child) {
+                    hhc += tocObject(titles.at(child), "pages/" + pageName(child));
+                }
+                hhc += "</UL>\n";
+            }
+        }
+        hhc += "</UL>\n</BODY></HTML>\n";
+
+        if (!writeFile(root.filePath("toc.hhc"), hhc, codec, error)) {
+            return false;
+        }
+
+        QString index = QString(
+            "<html>\n<head>\n"
+            "<meta http-equiv=\"Content-Type\" content=\"text/html; charset=%1\">\n"
+            "<title>%2</title>\n</head>\n<body>\n<a href=\"pages/%3\">%2</a>\n</body>\n</html>\n")
+            .arg(encoding, name, pageName(0));
+        if (!writeFile(root.filePath("index.html"), index, codec, error)) {
+            return false;
+        }
+    }
+
+    return true;
+}
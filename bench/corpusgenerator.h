@@ -0,0 +1,26 @@
+#ifndef CORPUSGENERATOR_H
+#define CORPUSGENERATOR_H
+
+#include <QByteArray>
+#include <QString>
+
+// Writes synthetic unpacked CHM trees (a .hhc table of contents plus pages)
+// so benchmark runs are reproducible without real manuals. The same seed
+// always produces byte-identical output.
+namespace CorpusGenerator
+{
+    struct Options
+    {
+        QString outDir;
+        QByteArray encoding = "UTF-8";  // Any QTextCodec name, e.g. UTF-8 or GBK
+        int archives = 1;
+        int pages = 200;                // Pages per archive
+        int wordsPerPage = 400;
+        quint32 seed = 1;
+    };
+
+    // Returns false and sets error when a file cannot be written
+    bool generate(const Options &options, QString *error);
+}
+
+#endif // CORPUSGENERATOR_H
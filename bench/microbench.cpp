@@ -0,0 +1,349 @@
+// chmreader-microbench: times the hot parsing kernels on a fixed synthetic
+// corpus and compares them against stored baselines. Each kernel is also
+// registered as a CTest test that fails when it is slower than its baseline
+// by more than the tolerance. Kernel times are divided by the time of a
+// fixed calibration workload measured in the same run, which evens out
+// clock scaling and background load between runs. That does not carry over
+// to other CPUs, compilers or Qt versions, so the baseline file records the
+// machine it was measured on and has to be re-recorded when that changes.
+
+#include "corpusgenerator.h"
+#include "htmlcodec.h"
+#include "htmltext.h"
+#include "searchindex.h"
+#include "tocparser.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+#include <functional>
+
+namespace
+{
+    const int kRepetitions = 11;
+    const qint64 kMinRepetitionNs = 20 * 1000 * 1000;
+
+    // Fixed inputs shared by all kernels
+    struct Inputs
+    {
+        QVector<QByteArray> pageBytes;  // Raw pages, half GBK and half UTF-8
+        QVector<QString> pageHtml;      // The same pages decoded
+        QVector<QString> pageText;      // The same pages with tags stripped
+        QString hhcContent;
+        QString hhcDir;
+        QVector<SearchIndex::PostingList> postings;  // Lists of very different lengths
+    };
+
+    struct Kernel
+    {
+        QString name;
+        int opsPerRun;  // Number of inputs processed by one call of run
+        std::function<void()> run;
+    };
+
+    bool loadInputs(Inputs *inputs, QString *error)
+    {
+        QTemporaryDir tmp;
+        if (!tmp.isValid()) {
+            *error = "Cannot create temporary directory";
+            return false;
+        }
+
+        // Changing these changes every baseline
+        CorpusGenerator::Options options;
+        options.outDir = tmp.path();
+        options.pages = 60;
+        options.wordsPerPage = 400;
+        options.seed = 42;
+        for (const char *encoding : {"GBK", "UTF-8"}) {
+            options.encoding = encoding;
+            if (!CorpusGenerator::generate(options, error)) {
+                return false;
+            }
+        }
+
+        QDirIterator it(tmp.path(), QStringList() << "*.html", QDir::Files, QDirIterator::Subdirectories);
+        QStringList pages;
+        while (it.hasNext()) {
+            pages << it.next();
+        }
+        pages.sort();
+
+        for (const QString &page : pages) {
+            QFile file(page);
+            if (!file.open(QIODevice::ReadOnly)) {
+                *error = "Cannot read " + page;
+                return false;
+            }
+            QByteArray data = file.readAll();
+            inputs->pageBytes << data;
+            inputs->pageHtml << HtmlCodec::transcode(data);
+            inputs->pageText << HtmlText::stripTags(inputs->pageHtml.last());
+        }
+
+        // A rare, a common and a very common term over 100k documents
+        const int strides[] = {97, 7, 2};
+        for (int stride : strides) {
+            SearchIndex::PostingList list;
+            for (int doc = 0; doc < 100000; doc += stride) {
+                list.append(SearchIndex::Posting{doc, 1 + doc % 3});
+            }
+            inputs->postings << list;
+        }
+
+        // The GBK table of contents exercises both decoding and the nesting logic
+        QString hhcPath = QDir(tmp.path()).filePath("corpus-gbk-0/toc.hhc");
+        inputs->hhcContent = HtmlCodec::readFile(hhcPath, "GBK");
+        inputs->hhcDir = QDir(tmp.path()).filePath("corpus-gbk-0");
+        return !inputs->hhcContent.isEmpty();
+    }
+
+    // Results go through a volatile sink so the work cannot be optimized away
+    volatile int sink = 0;
+
+    // Plain integer and memory work independent of Qt and of the corpus
+    Kernel makeCalibration()
+    {
+        return Kernel{"calibration", 1, []() {
+            QVector<quint32> values(16384);
+            quint32 state = 12345;
+            for (quint32 &value : values) {
+                state = state * 1664525u + 1013904223u;
+                value = state;
+            }
+            std::sort(values.begin(), values.end());
+
+            quint32 hash = 2166136261u;
+            for (quint32 value : values) {
+                hash = (hash ^ value) * 16777619u;
+            }
+            sink = sink + int(hash & 0xff);
+        }};
+    }
+
+    QVector<Kernel> makeKernels(const Inputs &inputs)
+    {
+        QVector<Kernel> kernels;
+        kernels.append(Kernel{"detectEncoding", inputs.pageBytes.size(), [&inputs]() {
+            for (const QByteArray &data : inputs.pageBytes) {
+                sink = sink + HtmlCodec::detectEncoding(data.left(8192)).size();
+            }
+        }});
+        kernels.append(Kernel{"transcode", inputs.pageBytes.size(), [&inputs]() {
+            for (const QByteArray &data : inputs.pageBytes) {
+                sink = sink + HtmlCodec::transcode(data).size();
+            }
+        }});
+        kernels.append(Kernel{"stripHtmlTags", inputs.pageHtml.size(), [&inputs]() {
+            for (const QString &html : inputs.pageHtml) {
+                sink = sink + HtmlText::stripTags(html).size();
+            }
+        }});
+        kernels.append(Kernel{"tocParse", 1, [&inputs]() {
+            sink = sink + TocParser::parse(inputs.hhcContent, inputs.hhcDir).size();
+        }});
+        kernels.append(Kernel{"tokenize", inputs.pageText.size(), [&inputs]() {
+            for (const QString &text : inputs.pageText) {
+                sink = sink + SearchIndex::tokenize(text).size();
+            }
+        }});
+        kernels.append(Kernel{"postingsIntersect", 1, [&inputs]() {
+            QVector<const SearchIndex::PostingList *> lists;
+            for (const SearchIndex::PostingList &list : inputs.postings) {
+                lists << &list;
+            }
+            sink = sink + SearchIndex::intersect(lists).size();
+        }});
+        return kernels;
+    }
+
+    // Median time per input over several repetitions, each long enough to be measurable
+    double measureNsPerOp(const Kernel &kernel)
+    {
+        QElapsedTimer timer;
+
+        // Warm up and calibrate how many calls make one repetition
+        timer.start();
+        kernel.run();
+        qint64 onceNs = qMax<qint64>(1, timer.nsecsElapsed());
+        int calls = int(qBound<qint64>(1, kMinRepetitionNs / onceNs, 100000));
+
+        QVector<double> samples;
+        for (int rep = 0; rep < kRepetitions; ++rep) {
+            timer.start();
+            for (int i = 0; i < calls; ++i) {
+                kernel.run();
+            }
+            samples << double(timer.nsecsElapsed()) / (double(calls) * kernel.opsPerRun);
+        }
+
+        std::sort(samples.begin(), samples.end());
+        return samples.at(samples.size() / 2);
+    }
+
+    QJsonObject readBaselines(const QString &path)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return QJsonObject();
+        }
+        return QJsonDocument::fromJson(file.readAll()).object();
+    }
+
+    // Where the baselines were measured, stored next to them
+    QJsonObject machineInfo()
+    {
+        QJsonObject machine;
+        machine["host"] = QSysInfo::machineHostName();
+        machine["os"] = QSysInfo::prettyProductName();
+        machine["cpu"] = QSysInfo::currentCpuArchitecture();
+        machine["qt"] = QString::fromLatin1(qVersion());
+        return machine;
+    }
+
+    QString describeMachine(const QJsonObject &machine)
+    {
+        return QString("%1 (%2, %3, Qt %4)").arg(machine.value("host").toString(),
+                                                 machine.value("os").toString(),
+                                                 machine.value("cpu").toString(),
+                                                 machine.value("qt").toString());
+    }
+
+    bool writeBaselines(const QString &path, const QJsonObject &baselines)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return false;
+        }
+        file.write(QJsonDocument(baselines).toJson());
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("chmreader-microbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Microbenchmarks for the CHM parsing kernels.");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"kernel", "Run only this kernel.", "name"},
+        {"baseline", "Baseline file to compare against (JSON).", "file"},
+        {"update-baseline", "Store the measured numbers in the baseline file."},
+        {"tolerance", "Allowed slowdown before failing, as a fraction.", "fraction", "0.20"},
+        {"list", "List the kernel names and exit."},
+    });
+    parser.process(app);
+
+    QTextStream out(stdout);
+
+    Inputs inputs;
+    QString error;
+    if (!loadInputs(&inputs, &error)) {
+        QTextStream(stderr) << error << endl;
+        return 1;
+    }
+
+    QVector<Kernel> kernels = makeKernels(inputs);
+    if (parser.isSet("list")) {
+        for (const Kernel &kernel : kernels) {
+            out << kernel.name << endl;
+        }
+        return 0;
+    }
+
+    const QString selected = parser.value("kernel");
+    const QString baselinePath = parser.value("baseline");
+    const double tolerance = parser.value("tolerance").toDouble();
+    QJsonObject baselines = readBaselines(baselinePath);
+
+    const QJsonObject recordedOn = baselines.value("machine").toObject();
+    if (!recordedOn.isEmpty() && !parser.isSet("update-baseline")) {
+        out << "baselines recorded on " << describeMachine(recordedOn) << endl;
+        if (recordedOn.value("host").toString() != QSysInfo::machineHostName()) {
+            out << "note: running on " << describeMachine(machineInfo())
+                << ", results may differ from the baselines" << endl;
+        }
+    }
+
+    const double calibrationNs = measureNsPerOp(makeCalibration());
+    out << qSetFieldWidth(18) << left << "calibration" << qSetFieldWidth(0)
+        << QString::number(calibrationNs, 'f', 0) << " ns" << endl;
+
+    bool found = false;
+    bool regressed = false;
+    bool missingBaseline = false;
+
+    for (const Kernel &kernel : kernels) {
+        if (!selected.isEmpty() && kernel.name != selected) {
+            continue;
+        }
+        found = true;
+
+        double nsPerOp = measureNsPerOp(kernel);
+        double relative = nsPerOp / calibrationNs;
+        out << qSetFieldWidth(18) << left << kernel.name << qSetFieldWidth(0)
+            << QString::number(nsPerOp, 'f', 0) << " ns/op, "
+            << QString::number(relative, 'f', 4) << " x calibration";
+
+        if (parser.isSet("update-baseline")) {
+            QJsonObject entry;
+            entry["relative"] = relative;
+            entry["ns_per_op"] = nsPerOp;  // For reference only, not compared
+            baselines[kernel.name] = entry;
+            out << "  (baseline updated)" << endl;
+            continue;
+        }
+
+        double baseline = baselines.value(kernel.name).toObject().value("relative").toDouble();
+        if (baseline <= 0.0) {
+            out << "  NO BASELINE" << endl;
+            missingBaseline = true;
+            continue;
+        }
+
+        double change = relative / baseline - 1.0;
+        out << "  baseline " << QString::number(baseline, 'f', 4) << " ("
+            << (change >= 0 ? "+" : "") << QString::number(change * 100.0, 'f', 1) << "%)";
+        if (change > tolerance) {
+            out << "  REGRESSION";
+            regressed = true;
+        }
+        out << endl;
+    }
+
+    if (!found) {
+        QTextStream(stderr) << "Unknown kernel " << selected << endl;
+        return 1;
+    }
+
+    if (parser.isSet("update-baseline")) {
+        baselines["machine"] = machineInfo();
+        if (baselinePath.isEmpty() || !writeBaselines(baselinePath, baselines)) {
+            QTextStream(stderr) << "Cannot write baseline file " << baselinePath << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // A kernel without a baseline is a failure, so the gate cannot pass by omission
+    if (missingBaseline) {
+        QTextStream(stderr) << "Record baselines with: chmreader-microbench --baseline "
+                            << baselinePath << " --update-baseline" << endl;
+        return 1;
+    }
+    return regressed ? 1 : 0;
+}
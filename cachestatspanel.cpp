@@ -0,0 +1,90 @@
+#include "cachestatspanel.h"
+#include "resourcecache.h"
+
+#include <QTreeWidget>
+#include <QHeaderView>
+#include <QLabel>
+#include <QTimer>
+#include <QVBoxLayout>
+
+namespace
+{
+    QString formatBytes(qint64 bytes)
+    {
+        if (bytes >= 1024 * 1024) {
+            return QString("%1 MB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+        }
+        return QString("%1 KB").arg(bytes / 1024.0, 0, 'f', 1);
+    }
+
+    void fillRow(QTreeWidgetItem *row, const QString &name, const ResourceCache::Stats &stats)
+    {
+        qint64 lookups = stats.hits + stats.misses;
+        QString hitRate = lookups > 0
+            ? QString("%1%").arg(100.0 * stats.hits / lookups, 0, 'f', 1)
+            : QString("-");
+
+        row->setText(0, name);
+        row->setText(1, QString::number(stats.entries));
+        row->setText(2, formatBytes(stats.residentBytes));
+        row->setText(3, hitRate);
+        row->setText(4, QString::number(stats.hits));
+        row->setText(5, QString::number(stats.misses));
+        row->setText(6, QString::number(stats.evictions));
+        row->setText(7, QString::number(stats.rejected));
+    }
+}
+
+CacheStatsPanel::CacheStatsPanel(ResourceCache *cache, QWidget *parent)
+    : QWidget(parent)
+    , m_cache(cache)
+{
+    auto layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+
+    m_budgetLabel = new QLabel(this);
+    layout->addWidget(m_budgetLabel);
+
+    m_table = new QTreeWidget(this);
+    m_table->setRootIsDecorated(false);
+    m_table->setHeaderLabels({tr("Type"), tr("Entries"), tr("Resident"), tr("Hit rate"),
+                              tr("Hits"), tr("Misses"), tr("Evictions"), tr("Rejected")});
+    m_table->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    layout->addWidget(m_table);
+
+    for (int type = 0; type < ResourceCache::TypeCount; ++type) {
+        new QTreeWidgetItem(m_table);
+    }
+    new QTreeWidgetItem(m_table);  // Totals
+
+    // Only poll while the panel is visible
+    m_timer = new QTimer(this);
+    m_timer->setInterval(1000);
+    connect(m_timer, &QTimer::timeout, this, &CacheStatsPanel::refresh);
+}
+
+void CacheStatsPanel::refresh()
+{
+    ResourceCache::Stats total = m_cache->totalStats();
+    m_budgetLabel->setText(tr("Resident %1 of %2 budget")
+                           .arg(formatBytes(total.residentBytes), formatBytes(m_cache->budget())));
+
+    for (int type = 0; type < ResourceCache::TypeCount; ++type) {
+        ResourceCache::Type cacheType = ResourceCache::Type(type);
+        fillRow(m_table->topLevelItem(type), ResourceCache::typeName(cacheType), m_cache->stats(cacheType));
+    }
+    fillRow(m_table->topLevelItem(ResourceCache::TypeCount), tr("Total"), total);
+}
+
+void CacheStatsPanel::showEvent(QShowEvent *event)
+{
+    QWidget::showEvent(event);
+    refresh();
+    m_timer->start();
+}
+
+void CacheStatsPanel::hideEvent(QHideEvent *event)
+{
+    QWidget::hideEvent(event);
+    m_timer->stop();
+}
@@ -0,0 +1,36 @@
+#ifndef CACHESTATSPANEL_H
+#define CACHESTATSPANEL_H
+
+#include <QWidget>
+
+QT_BEGIN_NAMESPACE
+class QTreeWidget;
+class QLabel;
+class QTimer;
+QT_END_NAMESPACE
+
+class ResourceCache;
+
+// Live view of the resource cache counters, one row per resource type
+class CacheStatsPanel : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit CacheStatsPanel(ResourceCache *cache, QWidget *parent = nullptr);
+
+public slots:
+    void refresh();
+
+protected:
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
+private:
+    ResourceCache *m_cache;
+    QLabel *m_budgetLabel = nullptr;
+    QTreeWidget *m_table = nullptr;
+    QTimer *m_timer = nullptr;
+};
+
+#endif // CACHESTATSPANEL_H
@@ -0,0 +1,99 @@
+#include "chmarchive.h"
+#include "trace.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QProcess>
+#include <QStringList>
+
+bool ChmArchive::unpack(const QString &chmPath, const QString &outDir, int timeoutMs)
+{
+    TRACE_SCOPE("unpackChm", chmPath);
+
+    // Use 7z x <chmPath> -o<outDir> -y
+    QString program = "7z"; // p7zip provides 7z on Linux
+    QStringList args;
+    args << "x" << chmPath << QString("-o%1").arg(outDir) << "-y";
+
+    QProcess proc;
+    proc.start(program, args);
+    bool started = proc.waitForStarted(5000);
+    if (!started) return false;
+    bool finished = proc.waitForFinished(timeoutMs);
+    if (!finished) {
+        proc.kill();
+        proc.waitForFinished();
+        return false;
+    }
+
+    int exitCode = proc.exitCode();
+    return exitCode == 0;
+}
+
+bool ChmArchive::extractFile(const QString &chmPath, const QString &innerPath, QByteArray *data)
+{
+    TRACE_SCOPE("extractFile", innerPath);
+
+    // Exactly one file: no wildcards, and nothing 7z could read as a switch
+    if (innerPath.isEmpty() || innerPath.contains('*') || innerPath.contains('?') || innerPath.startsWith('-')) {
+        return false;
+    }
+
+    // Use 7z x -so -spd -- <chmPath> <innerPath> to stream the file to stdout;
+    // -spd turns off wildcard matching and -- ends the switches
+    QStringList args;
+    args << "x" << "-so" << "-spd" << "--" << chmPath << innerPath;
+
+    QProcess proc;
+    proc.start("7z", args);
+    if (!proc.waitForStarted(5000)) return false;
+    if (!proc.waitForFinished(30000)) return false;
+    if (proc.exitCode() != 0) return false;
+
+    *data = proc.readAllStandardOutput();
+    return !data->isEmpty();
+}
+
+QString ChmArchive::findToc(const QString &rootDir)
+{
+    TRACE_SCOPE("findToc");
+    QDirIterator hhcIt(rootDir, QStringList() << "*.hhc", QDir::Files, QDirIterator::Subdirectories);
+    if (hhcIt.hasNext()) {
+        return hhcIt.next();
+    }
+    return QString();
+}
+
+QString ChmArchive::findFirstPage(const QString &rootDir)
+{
+    TRACE_SCOPE("findFirstPage");
+    QDirIterator htmlIt(rootDir, QStringList() << "*.html" << "*.htm",
+                        QDir::Files, QDirIterator::Subdirectories);
+    if (htmlIt.hasNext()) {
+        return htmlIt.next();
+    }
+    return QString();
+}
+
+QString ChmArchive::findHomePage(const QString &rootDir)
+{
+    const QString candidates[] = {"index.html", "index.htm", "default.html", "default.htm"};
+    for (const QString &c : candidates) {
+        QString path = QDir(rootDir).filePath(c);
+        if (QFile::exists(path)) {
+            return path;
+        }
+    }
+    return QString();
+}
+
+bool ChmArchive::isPage(const QString &path)
+{
+    return path.endsWith(".html", Qt::CaseInsensitive) || path.endsWith(".htm", Qt::CaseInsensitive);
+}
+
+bool ChmArchive::isSystemFile(const QString &fileName)
+{
+    return fileName.startsWith('#') || fileName.startsWith('$');
+}
@@ -0,0 +1,29 @@
+#ifndef CHMARCHIVE_H
+#define CHMARCHIVE_H
+
+#include <QByteArray>
+#include <QString>
+
+// Locating content inside a CHM archive that has been unpacked with 7z
+namespace ChmArchive
+{
+    // Extract the whole archive with `7z x`; returns false if 7z is missing, fails
+    // or takes longer than timeoutMs. Background jobs pass -1 to wait for as long
+    // as a large archive needs
+    bool unpack(const QString &chmPath, const QString &outDir, int timeoutMs = 30000);
+    // Extract a single file into memory without unpacking the rest of the archive;
+    // paths with wildcards or a leading '-' are rejected
+    bool extractFile(const QString &chmPath, const QString &innerPath, QByteArray *data);
+    // First .hhc table of contents below rootDir, or an empty string
+    QString findToc(const QString &rootDir);
+    // First .htm/.html page below rootDir, or an empty string
+    QString findFirstPage(const QString &rootDir);
+    // index.html, index.htm, default.html or default.htm at the top of rootDir
+    QString findHomePage(const QString &rootDir);
+    // Whether the path names an HTML page
+    bool isPage(const QString &path);
+    // Whether a file is one of the CHM internal system files (#SYSTEM, $FIftiMain ...)
+    bool isSystemFile(const QString &fileName);
+}
+
+#endif // CHMARCHIVE_H
@@ -0,0 +1,115 @@
+// chmreader-cli: headless front end to the core library. Links only
+// chmcore, so it runs on machines without a display or QtWebEngine.
+//   chmreader-cli --serve [--socket name] [--port n] [--threads n] [--library dir]
+//   chmreader-cli --export <chm> <dir>
+
+#include "library.h"
+#include "queryserver.h"
+#include "siteexporter.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+namespace
+{
+    // Answer queries against the library until the process is stopped
+    int runServer(QCoreApplication &app, const QCommandLineParser &parser)
+    {
+        QTextStream err(stderr);
+
+        QString storageDir = parser.value("library");
+        if (storageDir.isEmpty()) {
+            storageDir = Library::defaultStorageDir();
+        }
+
+        // Queries are answered from memory, so read every shard before listening
+        Library library(storageDir);
+        library.loadAll();
+
+        // Shards from an older format version are rebuilt once, before any query
+        for (const QString &chmPath : library.staleArchives()) {
+            QString error;
+            err << "Re-indexing " << chmPath << endl;
+            if (!library.addArchive(chmPath, &error)) {
+                err << error << endl;
+            }
+        }
+
+        QueryServer server(&library, parser.value("threads").toInt());
+        QString error;
+        if (!server.listenLocal(parser.value("socket"), &error)) {
+            err << "Cannot listen on " << parser.value("socket") << ": " << error << endl;
+            return 1;
+        }
+        if (parser.isSet("port") && !server.listenHttp(quint16(parser.value("port").toUInt()), &error)) {
+            err << "Cannot listen on port " << parser.value("port") << ": " << error << endl;
+            return 1;
+        }
+
+        err << "Serving " << library.archives().size() << " archives on " << parser.value("socket");
+        if (parser.isSet("port")) {
+            err << " and http://127.0.0.1:" << parser.value("port");
+        }
+        err << endl;
+
+        return app.exec();
+    }
+
+    // Convert an archive to a static UTF-8 site
+    int runExport(QCommandLineParser &parser)
+    {
+        QTextStream err(stderr);
+
+        const QStringList args = parser.positionalArguments();
+        if (args.size() != 2) {
+            parser.showHelp(1);
+        }
+
+        SiteExporter::Result result;
+        QString error;
+        if (!SiteExporter::exportSite(args.at(0), args.at(1), &result, &error)) {
+            err << error << endl;
+            return 1;
+        }
+
+        err << "Exported " << result.pages << " pages to " << result.indexPath << endl;
+        if (result.failed > 0) {
+            err << result.failed << " pages could not be converted" << endl;
+            return 1;
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    // Same names as the viewer, so both find the same library
+    app.setOrganizationName("chmreader");
+    app.setApplicationName("chmreader");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless tools for the CHM reader.");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"serve", "Run the query server."},
+        {"export", "Export <chm> as a static UTF-8 site into the new or empty directory <dir>."},
+        {"socket", "Local socket name or path.", "name", "chmreader"},
+        {"port", "Also serve HTTP on 127.0.0.1:<port>.", "port"},
+        {"threads", "Worker threads (default: one per core).", "count", "0"},
+        {"library", "Library directory (default: the viewer's library).", "dir"},
+    });
+    parser.addPositionalArgument("chm", "Archive to export (--export).", "[chm]");
+    parser.addPositionalArgument("dir", "Output directory (--export).", "[dir]");
+    parser.process(app);
+
+    if (parser.isSet("serve")) {
+        return runServer(app, parser);
+    }
+    if (parser.isSet("export")) {
+        return runExport(parser);
+    }
+
+    parser.showHelp(1);
+}
@@ -0,0 +1,155 @@
+#include "htmlcodec.h"
+#include "trace.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QTextCodec>
+#include <QRegularExpression>
+#include <QLoggingCategory>
+
+// Enable with QT_LOGGING_RULES="chmreader.codec.debug=true"
+Q_LOGGING_CATEGORY(lcCodec, "chmreader.codec", QtWarningMsg)
+
+QByteArray HtmlCodec::detectEncoding(const QByteArray &data)
+{
+    QString dataStr = QString::fromLatin1(data);
+
+    // Check for charset in meta tag
+    static const QRegularExpression charsetRx("charset\\s*=\\s*['\"]?([^'\"\\s>]+)",
+                                              QRegularExpression::CaseInsensitiveOption);
+    QRegularExpressionMatch match = charsetRx.match(dataStr);
+
+    if (match.hasMatch()) {
+        QString charset = match.captured(1).toUpper();
+
+        qCDebug(lcCodec) << "Found charset in meta tag:" << charset;
+
+        // Map common Chinese charsets
+        if (charset.contains("GBK") || charset.contains("GB2312") ||
+            charset.contains("GB-2312") || charset.contains("CP936")) {
+            return "GBK";
+        } else if (charset.contains("BIG5")) {
+            return "Big5";
+        } else if (charset.contains("UTF-8") || charset.contains("UTF8")) {
+            return "UTF-8";
+        }
+
+        return charset.toLatin1();
+    }
+
+    // Simple heuristic: check for GBK bytes
+    // GBK first byte: 0x81-0xFE, second byte: 0x40-0xFE
+    int gbkLikeCount = 0;
+    int utf8LikeCount = 0;
+
+    for (int i = 0; i < data.size() - 1; i++) {
+        unsigned char c1 = static_cast<unsigned char>(data[i]);
+        unsigned char c2 = static_cast<unsigned char>(data[i + 1]);
+
+        // Check for GBK pattern
+        if (c1 >= 0x81 && c1 <= 0xFE && c2 >= 0x40 && c2 <= 0xFE) {
+            gbkLikeCount++;
+        }
+
+        // Check for UTF-8 pattern
+        if ((c1 & 0xE0) == 0xE0 && (c2 & 0x80) == 0x80) {
+            utf8LikeCount++;
+        }
+    }
+
+    // If we find significant GBK patterns, use GBK
+    if (gbkLikeCount > utf8LikeCount && gbkLikeCount > 5) {
+        return "GBK";
+    }
+
+    // Default to UTF-8
+    return "UTF-8";
+}
+
+QByteArray HtmlCodec::detectFileEncoding(const QString &filePath)
+{
+    TRACE_SCOPE("detectEncoding");
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return "UTF-8";
+    }
+
+    // Read first 8KB to detect encoding
+    QByteArray data = file.read(8192);
+    file.close();
+
+    return detectEncoding(data);
+}
+
+QString HtmlCodec::readFile(const QString &filePath, const QByteArray &encoding)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return QString();
+    }
+
+    QTextStream in(&file);
+    in.setCodec(encoding.constData());
+    QString content = in.readAll();
+    file.close();
+
+    return content;
+}
+
+QString HtmlCodec::declareUtf8(QString content)
+{
+    // Update or add charset meta tag
+    static const QRegularExpression metaCharsetRx(
+        "<meta\\s+[^>]*charset\\s*=\\s*['\"]?[^'\"\\s>]+['\"]?[^>]*>",
+        QRegularExpression::CaseInsensitiveOption
+    );
+
+    const QString newMetaTag = "<meta http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\">";
+
+    if (content.contains(metaCharsetRx)) {
+        // Replace existing charset declaration
+        content.replace(metaCharsetRx, newMetaTag);
+    } else {
+        // Add charset declaration after <head>
+        static const QRegularExpression headRx("<head[^>]*>", QRegularExpression::CaseInsensitiveOption);
+        QRegularExpressionMatch match = headRx.match(content);
+        if (match.hasMatch()) {
+            int insertPos = match.capturedEnd();
+            content.insert(insertPos, "\n" + newMetaTag);
+        }
+    }
+
+    return content;
+}
+
+QString HtmlCodec::transcode(const QByteArray &data)
+{
+    QByteArray encoding = detectEncoding(data.left(8192));
+    QTextCodec *codec = QTextCodec::codecForName(encoding);
+    if (!codec) {
+        codec = QTextCodec::codecForLocale();
+    }
+
+    QString content = codec->toUnicode(data);
+    if (encoding != "UTF-8") {
+        content = declareUtf8(content);
+    }
+    return content;
+}
+
+QString HtmlCodec::transcodeFile(const QString &filePath)
+{
+    TRACE_SCOPE("transcodeFile");
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QString();
+    }
+
+    // Read once and detect from the head of the buffer instead of reopening the file
+    QByteArray data = file.readAll();
+    file.close();
+
+    return transcode(data);
+}
@@ -0,0 +1,25 @@
+#ifndef HTMLCODEC_H
+#define HTMLCODEC_H
+
+#include <QByteArray>
+#include <QString>
+
+// Encoding detection and UTF-8 transcoding of CHM pages.
+// All functions are reentrant and may be called from worker threads.
+namespace HtmlCodec
+{
+    // Detect the encoding of an HTML buffer from its meta tag or byte pattern
+    QByteArray detectEncoding(const QByteArray &data);
+    // Detect the encoding of a file by inspecting its first 8KB
+    QByteArray detectFileEncoding(const QString &filePath);
+    // Read a whole file and decode it with the given encoding
+    QString readFile(const QString &filePath, const QByteArray &encoding);
+    // Replace (or insert) the charset meta tag so the page declares UTF-8
+    QString declareUtf8(QString content);
+    // Decode a page buffer and return it as UTF-8 HTML
+    QString transcode(const QByteArray &data);
+    // Read a page and return it transcoded to UTF-8 HTML
+    QString transcodeFile(const QString &filePath);
+}
+
+#endif // HTMLCODEC_H
@@ -0,0 +1,42 @@
+#include "htmltext.h"
+
+#include <QRegularExpression>
+
+QString HtmlText::stripTags(const QString &html)
+{
+    static const QRegularExpression scriptRx("<script[^>]*>.*</script>", QRegularExpression::CaseInsensitiveOption | QRegularExpression::DotMatchesEverythingOption);
+    static const QRegularExpression styleRx("<style[^>]*>.*</style>", QRegularExpression::CaseInsensitiveOption | QRegularExpression::DotMatchesEverythingOption);
+    static const QRegularExpression tagRx("<[^>]*>");
+
+    QString text = html;
+
+    // Remove script and style tags with their content
+    text.remove(scriptRx);
+    text.remove(styleRx);
+
+    // Remove HTML tags
+    text.remove(tagRx);
+
+    // Decode HTML entities
+    text.replace("&nbsp;", " ");
+    text.replace("&lt;", "<");
+    text.replace("&gt;", ">");
+    text.replace("&amp;", "&");
+    text.replace("&quot;", "\"");
+    text.replace("&#39;", "'");
+
+    // Normalize whitespace
+    text = text.simplified();
+
+    return text;
+}
+
+QString HtmlText::extractTitle(const QString &html)
+{
+    static const QRegularExpression titleRx("<title>([^<]+)</title>", QRegularExpression::CaseInsensitiveOption);
+    QRegularExpressionMatch match = titleRx.match(html);
+    if (match.hasMatch()) {
+        return match.captured(1).simplified();
+    }
+    return QString();
+}
@@ -0,0 +1,15 @@
+#ifndef HTMLTEXT_H
+#define HTMLTEXT_H
+
+#include <QString>
+
+// Plain-text extraction from HTML pages, used by search
+namespace HtmlText
+{
+    // Remove scripts, styles and tags, decode common entities and normalize whitespace
+    QString stripTags(const QString &html);
+    // Text of the <title> element, or an empty string when there is none
+    QString extractTitle(const QString &html);
+}
+
+#endif // HTMLTEXT_H
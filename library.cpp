@@ -0,0 +1,332 @@
+#include "library.h"
+#include "chmarchive.h"
+#include "searchindex.h"
+#include "trace.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFuture>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include <algorithm>
+
+namespace
+{
+    struct ShardStats
+    {
+        QSharedPointer<SearchIndex> index;
+        QVector<int> frequencies;
+    };
+
+    bool higherScore(const LibraryHit &a, const LibraryHit &b)
+    {
+        return a.score > b.score;
+    }
+}
+
+Library::Library(const QString &storageDir)
+    : m_storageDir(storageDir)
+{
+    QDir().mkpath(m_storageDir);
+    loadRegistry();
+}
+
+Library::~Library()
+{
+}
+
+QString Library::defaultStorageDir()
+{
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).filePath("library");
+}
+
+QStringList Library::archives() const
+{
+    QMutexLocker locker(&m_mutex);
+    QStringList paths;
+    for (const Archive &archive : m_archives) {
+        paths << archive.chmPath;
+    }
+    return paths;
+}
+
+QStringList Library::staleArchives() const
+{
+    QMutexLocker locker(&m_mutex);
+    QStringList paths;
+    for (const Archive &archive : m_archives) {
+        if (archive.stale && !archive.broken) {
+            paths << archive.chmPath;
+        }
+    }
+    return paths;
+}
+
+bool Library::addArchive(const QString &chmPath, QString *error)
+{
+    TRACE_SCOPE("addArchive", chmPath);
+
+    QString absPath = QFileInfo(chmPath).absoluteFilePath();
+    QString shardPath = shardPathFor(absPath);
+
+    QSharedPointer<SearchIndex> index = buildShard(absPath, shardPath, error);
+    if (!index) {
+        // Remember a registered archive that cannot be rebuilt, so it is not
+        // unpacked again for every query
+        QMutexLocker locker(&m_mutex);
+        int i = find(absPath);
+        if (i != -1) {
+            m_archives[i].broken = true;
+        }
+        return false;
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        int i = find(absPath);
+        if (i == -1) {
+            Archive archive;
+            archive.chmPath = absPath;
+            archive.shardPath = shardPath;
+            m_archives.append(archive);
+            i = m_archives.size() - 1;
+        }
+        m_archives[i].index = index;
+        m_archives[i].stale = false;
+        m_archives[i].broken = false;
+    }
+
+    saveRegistry();
+    return true;
+}
+
+void Library::removeArchive(const QString &chmPath)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        int i = find(chmPath);
+        if (i == -1) return;
+        QFile::remove(m_archives.at(i).shardPath);
+        m_archives.remove(i);
+    }
+    saveRegistry();
+}
+
+QSharedPointer<SearchIndex> Library::shard(const QString &chmPath)
+{
+    QString shardPath;
+    {
+        QMutexLocker locker(&m_mutex);
+        int i = find(chmPath);
+        if (i == -1) return QSharedPointer<SearchIndex>();
+        const Archive &archive = m_archives.at(i);
+        if (archive.index || archive.stale) return archive.index;
+        shardPath = archive.shardPath;
+    }
+
+    // Load outside the lock so shards are read in parallel
+    QSharedPointer<SearchIndex> index(new SearchIndex);
+    const bool loaded = index->load(shardPath);
+
+    QMutexLocker locker(&m_mutex);
+    int i = find(chmPath);
+    if (i == -1) return loaded ? index : QSharedPointer<SearchIndex>();
+    if (!m_archives.at(i).index) {
+        if (loaded) {
+            m_archives[i].index = index;
+        } else {
+            // Rebuilding means unpacking the whole archive, which is up to the caller
+            m_archives[i].stale = true;
+        }
+    }
+    return m_archives.at(i).index;
+}
+
+void Library::loadAll()
+{
+    TRACE_SCOPE("loadAllShards");
+
+    QVector<QFuture<void>> futures;
+    for (const QString &chmPath : archives()) {
+        futures << QtConcurrent::run([this, chmPath]() {
+            shard(chmPath);
+        });
+    }
+    for (QFuture<void> &future : futures) {
+        future.waitForFinished();
+    }
+}
+
+QVector<LibraryHit> Library::search(const QString &query, int limit)
+{
+    TRACE_SCOPE("librarySearch", query);
+
+    QStringList terms = SearchIndex::tokenize(query);
+    terms.removeDuplicates();
+    const QStringList paths = archives();
+    if (terms.isEmpty() || paths.isEmpty()) {
+        return QVector<LibraryHit>();
+    }
+
+    // Phase 1: load the shards and gather document frequencies in parallel
+    QVector<QFuture<ShardStats>> statsFutures;
+    for (const QString &chmPath : paths) {
+        statsFutures << QtConcurrent::run([this, chmPath, terms]() {
+            ShardStats stats;
+            stats.index = shard(chmPath);
+            if (stats.index) {
+                stats.frequencies = stats.index->documentFrequencies(terms);
+            }
+            return stats;
+        });
+    }
+
+    QVector<ShardStats> shards;
+    int globalDocuments = 0;
+    QVector<int> globalFrequencies(terms.size(), 0);
+    for (QFuture<ShardStats> &future : statsFutures) {
+        ShardStats stats = future.result();
+        if (stats.index) {
+            globalDocuments += stats.index->documentCount();
+            for (int t = 0; t < terms.size(); ++t) {
+                globalFrequencies[t] += stats.frequencies.at(t);
+            }
+        }
+        shards << stats;
+    }
+
+    // Phase 2: score every shard against the collection-wide statistics
+    QVector<QFuture<QVector<LibraryHit>>> hitFutures;
+    for (int s = 0; s < shards.size(); ++s) {
+        QSharedPointer<SearchIndex> index = shards.at(s).index;
+        if (!index) continue;
+
+        const QString chmPath = paths.at(s);
+        hitFutures << QtConcurrent::run([index, chmPath, terms, globalFrequencies, globalDocuments, limit]() {
+            QVector<LibraryHit> hits;
+            const QString archiveName = QFileInfo(chmPath).completeBaseName();
+            for (const SearchIndex::Match &match : index->search(terms, globalFrequencies, globalDocuments)) {
+                const SearchIndex::Document &document = index->document(match.doc);
+                LibraryHit hit;
+                hit.chmPath = chmPath;
+                hit.archiveName = archiveName;
+                hit.path = document.path;
+                hit.title = document.title;
+                hit.summary = document.summary;
+                hit.score = match.score;
+                hits << hit;
+            }
+
+            // Only the best hits of a shard can make the global top
+            if (hits.size() > limit) {
+                std::partial_sort(hits.begin(), hits.begin() + limit, hits.end(), higherScore);
+                hits.resize(limit);
+            }
+            return hits;
+        });
+    }
+
+    // Merge the per-shard winners into one global ranking
+    QVector<LibraryHit> results;
+    for (QFuture<QVector<LibraryHit>> &future : hitFutures) {
+        results += future.result();
+    }
+    std::sort(results.begin(), results.end(), higherScore);
+    if (results.size() > limit) {
+        results.resize(limit);
+    }
+
+    return results;
+}
+
+QSharedPointer<SearchIndex> Library::buildShard(const QString &chmPath, const QString &shardPath, QString *error) const
+{
+    QTemporaryDir tmp;
+    if (!tmp.isValid()) {
+        *error = QString("Failed to create temporary directory.");
+        return QSharedPointer<SearchIndex>();
+    }
+    // Indexing runs in the background, so a large archive may take as long as it needs
+    if (!ChmArchive::unpack(chmPath, tmp.path(), -1)) {
+        *error = QString("Failed to unpack %1. Ensure p7zip (7z) is installed.").arg(chmPath);
+        return QSharedPointer<SearchIndex>();
+    }
+
+    // The unpacked pages are only needed while indexing
+    QSharedPointer<SearchIndex> index(new SearchIndex);
+    index->build(tmp.path());
+
+    if (!index->save(shardPath)) {
+        *error = QString("Failed to write index shard %1.").arg(shardPath);
+        return QSharedPointer<SearchIndex>();
+    }
+    return index;
+}
+
+QString Library::shardPathFor(const QString &chmPath) const
+{
+    QByteArray hash = QCryptographicHash::hash(chmPath.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QDir(m_storageDir).filePath(QString::fromLatin1(hash) + ".idx");
+}
+
+void Library::loadRegistry()
+{
+    QFile file(QDir(m_storageDir).filePath("library.json"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    // Only the list of archives is read at startup; shards load on demand
+    const QJsonArray entries = QJsonDocument::fromJson(file.readAll()).object().value("archives").toArray();
+    for (const QJsonValue &value : entries) {
+        Archive archive;
+        archive.chmPath = value.toString();
+        archive.shardPath = shardPathFor(archive.chmPath);
+        if (!archive.chmPath.isEmpty() && QFile::exists(archive.shardPath)) {
+            m_archives.append(archive);
+        }
+    }
+}
+
+void Library::saveRegistry() const
+{
+    // Archives may be added from several threads; the last write must see them all
+    QMutexLocker saveLocker(&m_saveMutex);
+
+    QJsonArray entries;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (const Archive &archive : m_archives) {
+            entries.append(archive.chmPath);
+        }
+    }
+
+    QJsonObject root;
+    root["archives"] = entries;
+
+    QSaveFile file(QDir(m_storageDir).filePath("library.json"));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    file.write(QJsonDocument(root).toJson());
+    file.commit();
+}
+
+int Library::find(const QString &chmPath) const
+{
+    for (int i = 0; i < m_archives.size(); ++i) {
+        if (m_archives.at(i).chmPath == chmPath) {
+            return i;
+        }
+    }
+    return -1;
+}
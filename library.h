@@ -0,0 +1,76 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class SearchIndex;
+
+struct LibraryHit
+{
+    QString chmPath;
+    QString archiveName;
+    QString path;  // Page path relative to the archive root
+    QString title;
+    QString summary;
+    double score = 0.0;
+};
+
+// A set of registered CHM archives, each with a persisted index shard.
+// Registering an archive indexes it once; afterwards only the shard file is
+// read, and only when a query needs it. Queries fan out over all shards in
+// parallel and the hits are ranked globally. Queries never unpack archives:
+// a shard that cannot be read (deleted, or from an older format version) is
+// skipped and reported by staleArchives(), for the caller to rebuild with
+// addArchive() off the query path.
+class Library
+{
+public:
+    // storageDir holds the registry and the shard files
+    explicit Library(const QString &storageDir);
+    ~Library();
+
+    // Per-user location shared by the GUI and the query server
+    static QString defaultStorageDir();
+
+    QStringList archives() const;
+    // Registered archives whose shard needs rebuilding and has not failed to rebuild
+    QStringList staleArchives() const;
+    // Unpack and index an archive; re-registering an archive rebuilds its shard
+    bool addArchive(const QString &chmPath, QString *error);
+    void removeArchive(const QString &chmPath);
+
+    QVector<LibraryHit> search(const QString &query, int limit = 200);
+
+    // Index of one archive, loading its shard on first use; null if it is stale
+    QSharedPointer<SearchIndex> shard(const QString &chmPath);
+    // Load every shard up front, for long-running processes that serve queries
+    void loadAll();
+
+private:
+    struct Archive
+    {
+        QString chmPath;
+        QString shardPath;
+        QSharedPointer<SearchIndex> index;  // Null until a query needs it
+        bool stale = false;   // Shard unreadable; skipped until rebuilt
+        bool broken = false;  // Rebuilding failed, e.g. the CHM was moved; not retried
+    };
+
+    // Unpack an archive to a temporary directory, index it and save the shard
+    QSharedPointer<SearchIndex> buildShard(const QString &chmPath, const QString &shardPath, QString *error) const;
+    QString shardPathFor(const QString &chmPath) const;
+    void loadRegistry();
+    void saveRegistry() const;
+    int find(const QString &chmPath) const;
+
+    QString m_storageDir;
+    mutable QMutex m_mutex;
+    mutable QMutex m_saveMutex;  // Serializes writes of the registry file
+    QVector<Archive> m_archives;
+};
+
+#endif // LIBRARY_H
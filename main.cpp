@@ -1,10 +1,26 @@
 #include "mainwindow.h"
+#include "trace.h"
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    a.setOrganizationName("chmreader");
+    a.setApplicationName("chmreader");
+
+    // CHMREADER_TRACE=<file> records spans for the whole session and writes
+    // them as a Chrome trace on exit
+    const QString tracePath = QString::fromLocal8Bit(qgetenv("CHMREADER_TRACE"));
+    if (!tracePath.isEmpty()) {
+        Trace::setEnabled(true);
+    }
+
     MainWindow w;
     w.show();
-    return a.exec();
+    int ret = a.exec();
+
+    if (!tracePath.isEmpty()) {
+        Trace::writeChromeJson(tracePath);
+    }
+    return ret;
 }
@@ -1,4 +1,14 @@
 #include "mainwindow.h"
+#include "htmlcodec.h"
+#include "pageprefetcher.h"
+#include "resourcecache.h"
+#include "cachestatspanel.h"
+#include "chmarchive.h"
+#include "tocparser.h"
+#include "pagesearch.h"
+#include "trace.h"
+#include "library.h"
+#include "siteexporter.h"
 
 #include <QMenuBar>
 #include <QAction>
@@ -8,36 +18,89 @@
 #include <QTreeWidget>
 #include <QHeaderView>
 #include <QDirIterator>
-#include <QProcess>
 #include <QTemporaryDir>
 #include <QMessageBox>
 #include <QFileInfo>
 #include <QUrl>
 #include <QFile>
+#include <QSaveFile>
 #include <QApplication>
 
 #include <QWebEngineView>
 #include <QDir>
 #include <QTextStream>
-#include <QRegularExpression>
 #include <QMap>
-#include <QStack>
 #include <QDebug>
 #include <QLineEdit>
 #include <QPushButton>
 #include <QVBoxLayout>
 #include <QWidget>
 #include <QLabel>
+#include <QDockWidget>
+#include <QInputDialog>
+#include <QSettings>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace
+{
+    // QWebEngineView::setHtml() passes the page as a percent-encoded data: URL,
+    // which cannot be larger than 2MB
+    const int kMaxSetHtmlUrlBytes = 2 * 1024 * 1024;
+    // Number of TOC children and following siblings to prefetch
+    const int kPrefetchFanout = 3;
+    // Range of the cache budget setting, in MB
+    const int kMinCacheBudgetMb = 4;
+    const int kMaxCacheBudgetMb = 4096;
+    // Item data of library search results: the archive and the page inside it
+    const int kArchiveRole = Qt::UserRole;
+    const int kPageRole = Qt::UserRole + 1;
+
+    // Whether setHtml() can display html; markup and CJK text grow up to 3x
+    // when percent-encoded, so the encoded size is what counts
+    bool fitsSetHtml(const QString &html)
+    {
+        const QByteArray utf8 = html.toUtf8();
+        if (utf8.size() >= kMaxSetHtmlUrlBytes) {
+            return false;  // Encoding never shrinks it
+        }
+        return utf8.toPercentEncoding().size() < kMaxSetHtmlUrlBytes;
+    }
+
+    struct ExportOutcome
+    {
+        bool ok = false;
+        SiteExporter::Result result;
+        QString error;
+    };
+}
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
 {
+    QSettings settings;
+    qint64 budgetMb = settings.value("cache/budgetMB", ResourceCache::DefaultBudget / (1024 * 1024)).toLongLong();
+    budgetMb = qBound<qint64>(kMinCacheBudgetMb, budgetMb, kMaxCacheBudgetMb);
+    m_cache = new ResourceCache(budgetMb * 1024 * 1024);
+    m_prefetcher = new PagePrefetcher(m_cache, this);
+    m_library = new Library(Library::defaultStorageDir());
     createUi();
 }
 
 MainWindow::~MainWindow()
 {
     cleanupTempDir();
+    
+    // The prefetcher inserts into the cache, so stop it first
+    delete m_prefetcher;
+    delete m_cache;
+    // Archives still being added or searched use the library
+    m_addFuture.waitForFinished();
+    m_searchFuture.waitForFinished();
+    delete m_library;
 }
 
 void MainWindow::createUi()
@@ -47,6 +110,43 @@ void MainWindow::createUi()
 
     menuBar()->addAction(openAct);
 
+    m_exportAct = new QAction(tr("Export as Site..."), this);
+    connect(m_exportAct, &QAction::triggered, this, &MainWindow::onExportSite);
+    menuBar()->addAction(m_exportAct);
+
+    // Cache statistics panel, hidden until requested from the View menu
+    auto statsDock = new QDockWidget(tr("Cache Statistics"), this);
+    statsDock->setWidget(new CacheStatsPanel(m_cache, statsDock));
+    addDockWidget(Qt::BottomDockWidgetArea, statsDock);
+    statsDock->hide();
+
+    auto budgetAct = new QAction(tr("Cache Budget..."), this);
+    connect(budgetAct, &QAction::triggered, this, &MainWindow::onSetCacheBudget);
+
+    auto traceAct = new QAction(tr("Record Trace"), this);
+    traceAct->setCheckable(true);
+    traceAct->setChecked(Trace::isEnabled());
+    connect(traceAct, &QAction::toggled, this, &MainWindow::onToggleTrace);
+
+    m_addLibraryAct = new QAction(tr("Add to Library..."), this);
+    connect(m_addLibraryAct, &QAction::triggered, this, &MainWindow::onAddToLibrary);
+    auto removeLibraryAct = new QAction(tr("Remove from Library..."), this);
+    connect(removeLibraryAct, &QAction::triggered, this, &MainWindow::onRemoveFromLibrary);
+    m_searchLibraryAct = new QAction(tr("Search Library"), this);
+    m_searchLibraryAct->setCheckable(true);
+
+    auto libraryMenu = menuBar()->addMenu(tr("Library"));
+    libraryMenu->addAction(m_addLibraryAct);
+    libraryMenu->addAction(removeLibraryAct);
+    libraryMenu->addSeparator();
+    libraryMenu->addAction(m_searchLibraryAct);
+
+    auto viewMenu = menuBar()->addMenu(tr("View"));
+    viewMenu->addAction(statsDock->toggleViewAction());
+    viewMenu->addAction(budgetAct);
+    viewMenu->addSeparator();
+    viewMenu->addAction(traceAct);
+
     // Create splitter for tree and view
     auto splitter = new QSplitter(this);
     
@@ -89,6 +189,9 @@ void MainWindow::createUi()
     m_view = new QWebEngineView(splitter);
 
     connect(m_tree, &QTreeWidget::itemActivated, this, &MainWindow::onTreeItemActivated);
+    connect(m_view, &QWebEngineView::loadStarted, this, [this]() {
+        m_pageLoadStartUs = Trace::isEnabled() ? Trace::nowUs() : -1;
+    });
     connect(m_view, &QWebEngineView::loadFinished, this, &MainWindow::onPageLoaded);
     
     splitter->setStretchFactor(0, 1);
@@ -104,6 +207,13 @@ void MainWindow::openChm()
     QString chmPath = QFileDialog::getOpenFileName(this, tr("Open CHM"), QString(), tr("CHM Files (*.chm);;All Files (*)"));
     if (chmPath.isEmpty()) return;
 
+    openArchive(chmPath, true);
+}
+
+bool MainWindow::openArchive(const QString &chmPath, bool showToc)
+{
+    TRACE_SCOPE("openChm", chmPath);
+
     // Clean up previous temporary directory if exists
     cleanupTempDir();
 
@@ -111,7 +221,7 @@ void MainWindow::openChm()
     QTemporaryDir tmp;
     if (!tmp.isValid()) {
         QMessageBox::critical(this, tr("Error"), tr("Failed to create temporary directory."));
-        return;
+        return false;
     }
 
     QString outDir = tmp.path();
@@ -122,36 +232,40 @@ void MainWindow::openChm()
     QString persistentOut = QDir::temp().filePath(QString::fromUtf8("chmreader_%1").arg(QCoreApplication::applicationPid()));
     QDir().mkpath(persistentOut);
 
-    bool ok = unpackChm(chmPath, persistentOut);
+    m_chmPath.clear();
+    bool ok = ChmArchive::unpack(chmPath, persistentOut);
     if (!ok) {
         QMessageBox::critical(this, tr("Error"), tr("Failed to unpack CHM. Ensure p7zip (7z) is installed."));
-        return;
+        return false;
     }
 
     m_tmpDir = persistentOut;
+    m_chmPath = chmPath;
     
     // Clear converted files cache for new CHM
     m_convertedFiles.clear();
+    m_prefetcher->reset();
+    m_cache->clear();
     
     // Detect encoding from first HTML file
-    QDirIterator htmlIt(persistentOut, QStringList() << "*.html" << "*.htm", 
-                        QDir::Files, QDirIterator::Subdirectories);
-    if (htmlIt.hasNext()) {
-        QString firstHtml = htmlIt.next();
-        m_detectedEncoding = detectEncoding(firstHtml);
+    QString firstHtml = ChmArchive::findFirstPage(persistentOut);
+    if (!firstHtml.isEmpty()) {
+        m_detectedEncoding = HtmlCodec::detectFileEncoding(firstHtml);
     } else {
         m_detectedEncoding = "UTF-8";
     }
 
+    // Archives opened from library results keep the results in the tree
+    if (!showToc) {
+        return true;
+    }
+
     // populate tree with hierarchical structure
     m_tree->clear();
     
     // Try to find and parse .hhc (Table of Contents) file
-    QString hhcPath;
-    QStringList hhcCandidates = {"*.hhc"};
-    QDirIterator hhcIt(persistentOut, hhcCandidates, QDir::Files, QDirIterator::Subdirectories);
-    if (hhcIt.hasNext()) {
-        hhcPath = hhcIt.next();
+    QString hhcPath = ChmArchive::findToc(persistentOut);
+    if (!hhcPath.isEmpty()) {
         buildTocTree(hhcPath);
     }
     
@@ -161,44 +275,33 @@ void MainWindow::openChm()
     }
 
     // try to open index.html or default.htm
-    QString candidates[] = {"index.html", "index.htm", "default.html", "default.htm"};
-    for (const QString &c : candidates) {
-        QString path = QDir(persistentOut).filePath(c);
-        if (QFile::exists(path)) {
-            // Detect and fix encoding if needed (only once)
-            if (!m_convertedFiles.contains(path)) {
-                QByteArray fileEncoding = detectEncoding(path);
-                if (fileEncoding != "UTF-8") {
-                    fixHtmlEncoding(path, fileEncoding);
-                }
-                m_convertedFiles.insert(path);
+    QString path = ChmArchive::findHomePage(persistentOut);
+    if (!path.isEmpty()) {
+        // Detect and fix encoding if needed (only once)
+        if (!m_convertedFiles.contains(path)) {
+            QByteArray fileEncoding = HtmlCodec::detectFileEncoding(path);
+            if (fileEncoding != "UTF-8") {
+                fixHtmlEncoding(path, fileEncoding);
+            }
+            m_convertedFiles.insert(path);
+        }
+        m_view->load(QUrl::fromLocalFile(path));
+        
+        // Warm the cache with the start of the TOC and the front page's links
+        QStringList paths;
+        for (int i = 0; i < m_tree->topLevelItemCount() && paths.size() < kPrefetchFanout; ++i) {
+            QString tocPath = m_tree->topLevelItem(i)->text(1);
+            if (ChmArchive::isPage(tocPath)) {
+                paths << tocPath;
             }
-            m_view->load(QUrl::fromLocalFile(path));
-            break;
         }
+        m_prefetcher->prefetch(paths, path);
     }
     
     // Clear search keyword when opening new CHM
     m_currentSearchKeyword.clear();
     m_searchEdit->clear();
-}
-
-bool MainWindow::unpackChm(const QString &chmPath, const QString &outDir)
-{
-    // Use 7z x <chmPath> -o<outDir> -y
-    QString program = "7z"; // p7zip provides 7z on Linux
-    QStringList args;
-    args << "x" << chmPath << QString("-o%1").arg(outDir) << "-y";
-
-    QProcess proc;
-    proc.start(program, args);
-    bool started = proc.waitForStarted(5000);
-    if (!started) return false;
-    bool finished = proc.waitForFinished(30000);
-    if (!finished) return false;
-
-    int exitCode = proc.exitCode();
-    return exitCode == 0;
+    return true;
 }
 
 void MainWindow::onTreeItemActivated()
@@ -206,13 +309,29 @@ void MainWindow::onTreeItemActivated()
     auto item = m_tree->currentItem();
     if (!item) return;
     QString path = item->text(1);
-    if (path.isEmpty()) return;
+    if (path.isEmpty()) {
+        // Library results name a page inside an archive that may not be open yet
+        QString chmPath = item->data(0, kArchiveRole).toString();
+        if (chmPath.isEmpty()) return;
+        if (chmPath != m_chmPath && !openArchive(chmPath, false)) return;
+        path = QDir(m_tmpDir).filePath(item->data(0, kPageRole).toString());
+    }
+
+    TRACE_SCOPE("activateItem", path);
 
     // Fix encoding for HTML files if needed (only once per file)
-    if ((path.endsWith(".html", Qt::CaseInsensitive) || path.endsWith(".htm", Qt::CaseInsensitive))) {
+    if (ChmArchive::isPage(path)) {
+        // Serve prefetched pages straight from memory
+        QString html;
+        if (m_cache->lookup(ResourceCache::Page, path, &html) && fitsSetHtml(html)) {
+            m_view->setHtml(html, QUrl::fromLocalFile(path));
+            prefetchAround(item, path);
+            return;
+        }
+        
         if (!m_convertedFiles.contains(path)) {
             // Detect encoding for this specific file
-            QByteArray fileEncoding = detectEncoding(path);
+            QByteArray fileEncoding = HtmlCodec::detectFileEncoding(path);
             if (fileEncoding != "UTF-8") {
                 fixHtmlEncoding(path, fileEncoding);
             }
@@ -223,10 +342,45 @@ void MainWindow::onTreeItemActivated()
     // Only load HTML files; for others, try to open raw data or show as file://
     QUrl url = QUrl::fromLocalFile(path);
     m_view->load(url);
+    
+    prefetchAround(item, path);
+}
+
+void MainWindow::prefetchAround(QTreeWidgetItem *item, const QString &path)
+{
+    // Predict the next pages in reading order: children first, then the
+    // following siblings, then the one before. Links of the current page
+    // are followed after that.
+    QStringList paths;
+    auto addPath = [&paths](QTreeWidgetItem *candidate) {
+        if (!candidate) return;
+        QString candidatePath = candidate->text(1);
+        if (ChmArchive::isPage(candidatePath)) {
+            paths << candidatePath;
+        }
+    };
+    
+    for (int i = 0; i < item->childCount() && i < kPrefetchFanout; ++i) {
+        addPath(item->child(i));
+    }
+    
+    QTreeWidgetItem *parent = item->parent();
+    int count = parent ? parent->childCount() : m_tree->topLevelItemCount();
+    int index = parent ? parent->indexOfChild(item) : m_tree->indexOfTopLevelItem(item);
+    for (int i = index + 1; i < count && i <= index + kPrefetchFanout; ++i) {
+        addPath(parent ? parent->child(i) : m_tree->topLevelItem(i));
+    }
+    if (index > 0) {
+        addPath(parent ? parent->child(index - 1) : m_tree->topLevelItem(index - 1));
+    }
+    
+    m_prefetcher->prefetch(paths, ChmArchive::isPage(path) ? path : QString());
 }
 
 void MainWindow::buildFileTree(const QString &rootPath)
 {
+    TRACE_SCOPE("buildFileTree");
+    
     QMap<QString, QTreeWidgetItem*> dirItems;
     dirItems[rootPath] = nullptr;
     
@@ -238,7 +392,7 @@ void MainWindow::buildFileTree(const QString &rootPath)
         
         // Skip system files
         QString fileName = fi.fileName();
-        if (fileName.startsWith('#') || fileName.startsWith('$')) {
+        if (ChmArchive::isSystemFile(fileName)) {
             continue;
         }
         
@@ -277,252 +431,62 @@ void MainWindow::buildFileTree(const QString &rootPath)
 
 void MainWindow::buildTocTree(const QString &hhcPath)
 {
-    QFile file(hhcPath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        return;
-    }
-    
-    // Detect encoding
-    QByteArray encoding = detectEncoding(hhcPath);
-    
-    QTextStream in(&file);
-    in.setCodec(encoding.constData());
-    QString content = in.readAll();
-    file.close();
-    
-    // Parse HTML-like .hhc file
-    // .hhc files contain nested <UL> and <LI> with <OBJECT> containing <param> tags
-    QStack<QTreeWidgetItem*> itemStack;
-    itemStack.push(nullptr); // Root level
-    
-    QRegularExpression ulStart("<\\s*ul\\s*>", QRegularExpression::CaseInsensitiveOption);
-    QRegularExpression ulEnd("</\\s*ul\\s*>", QRegularExpression::CaseInsensitiveOption);
-    QRegularExpression liStart("<\\s*li\\s*>", QRegularExpression::CaseInsensitiveOption);
-    QRegularExpression paramRx("<\\s*param\\s+name\\s*=\\s*\"([^\"]+)\"\\s+value\\s*=\\s*\"([^\"]+)\"", 
-                               QRegularExpression::CaseInsensitiveOption);
+    TRACE_SCOPE("buildTocTree");
     
-    int pos = 0;
-    QString currentName;
-    QString currentLocal;
+    const QVector<TocEntry> entries = TocParser::parseFile(hhcPath);
     
-    while (pos < content.length()) {
-        // Find next tag
-        int ulStartPos = content.indexOf(ulStart, pos);
-        int ulEndPos = content.indexOf(ulEnd, pos);
-        int liStartPos = content.indexOf(liStart, pos);
-        
-        // Determine which comes first
-        int nextPos = content.length();
-        enum TagType { UL_START, UL_END, LI_START, NONE } nextTag = NONE;
-        
-        if (ulStartPos != -1 && ulStartPos < nextPos) { nextPos = ulStartPos; nextTag = UL_START; }
-        if (ulEndPos != -1 && ulEndPos < nextPos) { nextPos = ulEndPos; nextTag = UL_END; }
-        if (liStartPos != -1 && liStartPos < nextPos) { nextPos = liStartPos; nextTag = LI_START; }
-        
-        if (nextTag == NONE) break;
-        
-        if (nextTag == UL_START) {
-            // Nothing to do, just move forward
-            pos = nextPos + 4;
-        } else if (nextTag == UL_END) {
-            // Pop from stack
-            if (itemStack.size() > 1) {
-                itemStack.pop();
-            }
-            pos = nextPos + 5;
-        } else if (nextTag == LI_START) {
-            // Extract parameters until next </object> or next <li>
-            int objEnd = content.indexOf("</object>", nextPos, Qt::CaseInsensitive);
-            if (objEnd == -1) objEnd = content.indexOf("<li>", nextPos + 4, Qt::CaseInsensitive);
-            if (objEnd == -1) objEnd = content.length();
-            
-            QString objContent = content.mid(nextPos, objEnd - nextPos);
-            
-            // Extract name and local parameters
-            currentName.clear();
-            currentLocal.clear();
-            
-            QRegularExpressionMatchIterator matchIt = paramRx.globalMatch(objContent);
-            while (matchIt.hasNext()) {
-                QRegularExpressionMatch match = matchIt.next();
-                QString paramName = match.captured(1).toLower();
-                QString paramValue = match.captured(2);
-                
-                if (paramName == "name") {
-                    currentName = paramValue;
-                } else if (paramName == "local") {
-                    currentLocal = paramValue;
-                }
-            }
-            
-            // Create tree item if we have a name
-            if (!currentName.isEmpty()) {
-                QTreeWidgetItem *parentItem = itemStack.top();
-                QTreeWidgetItem *newItem;
-                
-                if (parentItem) {
-                    newItem = new QTreeWidgetItem(parentItem);
-                } else {
-                    newItem = new QTreeWidgetItem(m_tree);
-                }
-                
-                newItem->setText(0, currentName);
-                
-                // Resolve local path relative to .hhc location
-                if (!currentLocal.isEmpty()) {
-                    QString absPath = QFileInfo(hhcPath).dir().filePath(currentLocal);
-                    absPath = QFileInfo(absPath).absoluteFilePath();
-                    newItem->setText(1, absPath);
-                }
-                
-                // Check if next is <ul> (has children)
-                int nextUlPos = content.indexOf(ulStart, objEnd);
-                int nextLiPos = content.indexOf(liStart, objEnd);
-                int nextUlEndPos = content.indexOf(ulEnd, objEnd);
-                
-                if (nextUlPos != -1 && (nextLiPos == -1 || nextUlPos < nextLiPos) && (nextUlEndPos == -1 || nextUlPos < nextUlEndPos)) {
-                    // This item has children, push it to stack
-                    itemStack.push(newItem);
-                }
-            }
-            
-            pos = objEnd;
+    // Entries come in document order, so a parent item always exists before its children
+    QVector<QTreeWidgetItem*> items;
+    items.reserve(entries.size());
+    for (const TocEntry &entry : entries) {
+        QTreeWidgetItem *newItem;
+        if (entry.parent >= 0) {
+            newItem = new QTreeWidgetItem(items.at(entry.parent));
+        } else {
+            newItem = new QTreeWidgetItem(m_tree);
         }
+        newItem->setText(0, entry.name);
+        newItem->setText(1, entry.path);
+        items.append(newItem);
     }
     
     m_tree->expandToDepth(1);
 }
 
-QByteArray MainWindow::detectEncoding(const QString &filePath)
-{
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
-        return "UTF-8";
-    }
-    
-    // Read first 8KB to detect encoding
-    QByteArray data = file.read(8192);
-    file.close();
-    
-    QString dataStr = QString::fromLatin1(data);
-    
-    // Check for charset in meta tag
-    QRegularExpression charsetRx("charset\\s*=\\s*['\"]?([^'\"\\s>]+)", 
-                                  QRegularExpression::CaseInsensitiveOption);
-    QRegularExpressionMatch match = charsetRx.match(dataStr);
-    
-    if (match.hasMatch()) {
-        QString charset = match.captured(1).toUpper();
-        
-        qDebug() << "Found charset in meta tag:" << charset << "for file:" << filePath;
-        
-        // Map common Chinese charsets
-        if (charset.contains("GBK") || charset.contains("GB2312") || 
-            charset.contains("GB-2312") || charset.contains("CP936")) {
-            return "GBK";
-        } else if (charset.contains("BIG5")) {
-            return "Big5";
-        } else if (charset.contains("UTF-8") || charset.contains("UTF8")) {
-            return "UTF-8";
-        }
-        
-        return charset.toLatin1();
-    }
-    
-    // Simple heuristic: check for GBK bytes
-    // GBK first byte: 0x81-0xFE, second byte: 0x40-0xFE
-    int gbkLikeCount = 0;
-    int utf8LikeCount = 0;
-    
-    for (int i = 0; i < data.size() - 1; i++) {
-        unsigned char c1 = static_cast<unsigned char>(data[i]);
-        unsigned char c2 = static_cast<unsigned char>(data[i + 1]);
-        
-        // Check for GBK pattern
-        if (c1 >= 0x81 && c1 <= 0xFE && c2 >= 0x40 && c2 <= 0xFE) {
-            gbkLikeCount++;
-        }
-        
-        // Check for UTF-8 pattern
-        if ((c1 & 0xE0) == 0xE0 && (c2 & 0x80) == 0x80) {
-            utf8LikeCount++;
-        }
-    }
-    
-    // If we find significant GBK patterns, use GBK
-    if (gbkLikeCount > utf8LikeCount && gbkLikeCount > 5) {
-        return "GBK";
-    }
-    
-    // Default to UTF-8
-    return "UTF-8";
-}
-
-QString MainWindow::readFileWithEncoding(const QString &filePath, const QByteArray &encoding)
-{
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        return QString();
-    }
-    
-    QTextStream in(&file);
-    in.setCodec(encoding.constData());
-    QString content = in.readAll();
-    file.close();
-    
-    return content;
-}
-
 void MainWindow::fixHtmlEncoding(const QString &htmlPath, const QByteArray &encoding)
 {
+    TRACE_SCOPE("fixHtmlEncoding", htmlPath);
+    
     qDebug() << "Converting file:" << htmlPath << "from encoding:" << encoding << "to UTF-8";
     
     // Read file with detected encoding
-    QFile file(htmlPath);
-    if (!file.open(QIODevice::ReadOnly)) {
+    QString content = HtmlCodec::readFile(htmlPath, encoding);
+    if (content.isEmpty()) {
         qDebug() << "Failed to open file for reading:" << htmlPath;
         return;
     }
     
-    QTextStream in(&file);
-    in.setCodec(encoding.constData());
-    QString content = in.readAll();
-    file.close();
+    content = HtmlCodec::declareUtf8(content);
     
-    // Update or add charset meta tag
-    QRegularExpression metaCharsetRx(
-        "<meta\\s+[^>]*charset\\s*=\\s*['\"]?[^'\"\\s>]+['\"]?[^>]*>",
-        QRegularExpression::CaseInsensitiveOption
-    );
-    
-    QString newMetaTag = "<meta http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\">";
-    
-    if (content.contains(metaCharsetRx)) {
-        // Replace existing charset declaration
-        content.replace(metaCharsetRx, newMetaTag);
-    } else {
-        // Add charset declaration after <head>
-        QRegularExpression headRx("<head[^>]*>", QRegularExpression::CaseInsensitiveOption);
-        QRegularExpressionMatch match = headRx.match(content);
-        if (match.hasMatch()) {
-            int insertPos = match.capturedEnd();
-            content.insert(insertPos, "\n" + newMetaTag);
-        }
-    }
-    
-    // Write back as UTF-8
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    // Write back as UTF-8; QSaveFile swaps the file in atomically so the
+    // prefetcher never reads a half-written page
+    QSaveFile file(htmlPath);
+    if (!file.open(QIODevice::WriteOnly)) {
         return;
     }
     
     QTextStream out(&file);
     out.setCodec("UTF-8");
     out << content;
-    file.close();
+    out.flush();
+    file.commit();
 }
 
 void MainWindow::cleanupTempDir()
 {
+    // Stop prefetching before the files go away
+    m_prefetcher->reset();
+    
     if (m_tmpDir.isEmpty()) {
         return;
     }
@@ -542,6 +506,36 @@ void MainWindow::cleanupTempDir()
     }
 }
 
+void MainWindow::onSetCacheBudget()
+{
+    bool ok = false;
+    int budgetMb = QInputDialog::getInt(this, tr("Cache Budget"), tr("Memory budget for cached pages (MB):"),
+                                        int(m_cache->budget() / (1024 * 1024)),
+                                        kMinCacheBudgetMb, kMaxCacheBudgetMb, 4, &ok);
+    if (!ok) return;
+    
+    m_cache->setBudget(qint64(budgetMb) * 1024 * 1024);
+    QSettings().setValue("cache/budgetMB", budgetMb);
+}
+
+void MainWindow::onToggleTrace(bool enabled)
+{
+    if (enabled) {
+        Trace::clear();
+        Trace::setEnabled(true);
+        return;
+    }
+    
+    Trace::setEnabled(false);
+    QString path = QFileDialog::getSaveFileName(this, tr("Save Trace"), "chmreader-trace.json",
+                                                tr("Chrome Trace (*.json);;All Files (*)"));
+    if (path.isEmpty()) return;
+    
+    if (!Trace::writeChromeJson(path)) {
+        QMessageBox::critical(this, tr("Error"), tr("Failed to write trace file."));
+    }
+}
+
 void MainWindow::onSearch()
 {
     QString keyword = m_searchEdit->text().trimmed();
@@ -550,6 +544,12 @@ void MainWindow::onSearch()
         return;
     }
     
+    if (m_searchLibraryAct->isChecked()) {
+        m_currentSearchKeyword = keyword;
+        searchLibrary(keyword);
+        return;
+    }
+    
     if (m_tmpDir.isEmpty()) {
         QMessageBox::information(this, tr("Search"), tr("Please open a CHM file first."));
         return;
@@ -561,6 +561,94 @@ void MainWindow::onSearch()
     searchInFiles(keyword);
 }
 
+void MainWindow::onAddToLibrary()
+{
+    QStringList chmPaths = QFileDialog::getOpenFileNames(this, tr("Add to Library"), QString(), tr("CHM Files (*.chm);;All Files (*)"));
+    if (chmPaths.isEmpty()) return;
+    
+    indexArchives(chmPaths);
+}
+
+void MainWindow::indexArchives(const QStringList &chmPaths)
+{
+    // Each archive is unpacked and indexed once, then only its shard is kept.
+    // Archives are indexed in parallel in the background; the viewer stays usable.
+    m_addLibraryAct->setEnabled(false);
+    auto watcher = new QFutureWatcher<QStringList>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher]() {
+        QStringList failures = watcher->result();
+        watcher->deleteLater();
+        m_addLibraryAct->setEnabled(true);
+
+        if (!failures.isEmpty()) {
+            QMessageBox::warning(this, tr("Library"), failures.join("\n"));
+        }
+    });
+
+    Library *library = m_library;
+    m_addFuture = QtConcurrent::run([library, chmPaths]() {
+        QMutex mutex;
+        QStringList failures;
+        QStringList paths = chmPaths;
+        QtConcurrent::blockingMap(paths, [library, &mutex, &failures](const QString &chmPath) {
+            QString error;
+            if (!library->addArchive(chmPath, &error)) {
+                QMutexLocker locker(&mutex);
+                failures << error;
+            }
+        });
+        return failures;
+    });
+    watcher->setFuture(m_addFuture);
+}
+
+void MainWindow::onRemoveFromLibrary()
+{
+    QStringList archives = m_library->archives();
+    if (archives.isEmpty()) {
+        QMessageBox::information(this, tr("Library"), tr("The library is empty."));
+        return;
+    }
+    
+    bool ok = false;
+    QString chmPath = QInputDialog::getItem(this, tr("Remove from Library"), tr("Archive:"), archives, 0, false, &ok);
+    if (!ok) return;
+    
+    m_library->removeArchive(chmPath);
+}
+
+void MainWindow::onExportSite()
+{
+    QString chmPath = QFileDialog::getOpenFileName(this, tr("Export CHM"), m_chmPath, tr("CHM Files (*.chm);;All Files (*)"));
+    if (chmPath.isEmpty()) return;
+    QString outDir = QFileDialog::getExistingDirectory(this, tr("Export to Empty Directory"));
+    if (outDir.isEmpty()) return;
+
+    // The conversion runs on all cores in the background; the viewer stays usable
+    m_exportAct->setEnabled(false);
+    auto watcher = new QFutureWatcher<ExportOutcome>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher]() {
+        ExportOutcome outcome = watcher->result();
+        watcher->deleteLater();
+        m_exportAct->setEnabled(true);
+
+        if (!outcome.ok) {
+            QMessageBox::critical(this, tr("Export"), outcome.error);
+        } else if (outcome.result.failed > 0) {
+            QMessageBox::warning(this, tr("Export"), tr("Exported %1 pages to %2; %3 pages could not be converted.")
+                                 .arg(outcome.result.pages).arg(outcome.result.indexPath).arg(outcome.result.failed));
+        } else {
+            QMessageBox::information(this, tr("Export"), tr("Exported %1 pages to %2.")
+                                     .arg(outcome.result.pages).arg(outcome.result.indexPath));
+        }
+    });
+    watcher->setFuture(QtConcurrent::run([chmPath, outDir]() {
+        ExportOutcome outcome;
+        outcome.ok = SiteExporter::exportSite(chmPath, outDir, &outcome.result, &outcome.error);
+        return outcome;
+    }));
+}
+
 void MainWindow::onSearchTextChanged(const QString &text)
 {
     // Enable/disable search button based on text
@@ -581,11 +669,8 @@ void MainWindow::onClearSearch()
     m_tree->clear();
     
     // Try to find and parse .hhc (Table of Contents) file
-    QString hhcPath;
-    QStringList hhcCandidates = {"*.hhc"};
-    QDirIterator hhcIt(m_tmpDir, hhcCandidates, QDir::Files, QDirIterator::Subdirectories);
-    if (hhcIt.hasNext()) {
-        hhcPath = hhcIt.next();
+    QString hhcPath = ChmArchive::findToc(m_tmpDir);
+    if (!hhcPath.isEmpty()) {
         buildTocTree(hhcPath);
     }
     
@@ -597,69 +682,22 @@ void MainWindow::onClearSearch()
 
 void MainWindow::searchInFiles(const QString &keyword)
 {
+    TRACE_SCOPE("searchInFiles", keyword);
+    
     m_tree->clear();
     
     QTreeWidgetItem *rootItem = new QTreeWidgetItem(m_tree);
     rootItem->setText(0, tr("Search Results: \"%1\"").arg(keyword));
     rootItem->setExpanded(true);
     
-    int matchCount = 0;
+    const QVector<SearchHit> hits = PageSearch::search(m_tmpDir, keyword, m_cache);
+    int matchCount = hits.size();
     
-    // Search in all HTML files
-    QDirIterator it(m_tmpDir, QStringList() << "*.html" << "*.htm", 
-                    QDir::Files, QDirIterator::Subdirectories);
-    
-    while (it.hasNext()) {
-        QString filePath = it.next();
-        QFileInfo fileInfo(filePath);
-        
-        // Skip system files
-        if (fileInfo.fileName().startsWith('#') || fileInfo.fileName().startsWith('$')) {
-            continue;
-        }
-        
-        // Detect encoding for this file
-        QByteArray encoding = detectEncoding(filePath);
-        
-        // Read file content
-        QFile file(filePath);
-        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            continue;
-        }
-        
-        QTextStream in(&file);
-        in.setCodec(encoding.constData());
-        QString content = in.readAll();
-        file.close();
-        
-        // Strip HTML tags for searching
-        QString plainText = stripHtmlTags(content);
-        
-        // Search for keyword (case insensitive)
-        if (plainText.contains(keyword, Qt::CaseInsensitive)) {
-            matchCount++;
-            
-            // Extract title from HTML
-            QString title = fileInfo.fileName();
-            QRegularExpression titleRx("<title>([^<]+)</title>", QRegularExpression::CaseInsensitiveOption);
-            QRegularExpressionMatch match = titleRx.match(content);
-            if (match.hasMatch()) {
-                title = match.captured(1).trimmed();
-            }
-            
-            // Find context around the keyword
-            int pos = plainText.indexOf(keyword, 0, Qt::CaseInsensitive);
-            int contextStart = qMax(0, pos - 50);
-            int contextEnd = qMin(plainText.length(), pos + keyword.length() + 50);
-            QString context = plainText.mid(contextStart, contextEnd - contextStart).trimmed();
-            if (contextStart > 0) context = "..." + context;
-            if (contextEnd < plainText.length()) context = context + "...";
-            
-            auto item = new QTreeWidgetItem(rootItem);
-            item->setText(0, QString("%1 - %2").arg(title, context));
-            item->setText(1, filePath);
-            item->setToolTip(0, context);
-        }
+    for (const SearchHit &hit : hits) {
+        auto item = new QTreeWidgetItem(rootItem);
+        item->setText(0, QString("%1 - %2").arg(hit.title, hit.context));
+        item->setText(1, hit.path);
+        item->setToolTip(0, hit.context);
     }
     
     rootItem->setText(0, tr("Search Results: \"%1\" (%2 matches)").arg(keyword).arg(matchCount));
@@ -671,33 +709,94 @@ void MainWindow::searchInFiles(const QString &keyword)
     }
 }
 
-QString MainWindow::stripHtmlTags(const QString &html)
+void MainWindow::searchLibrary(const QString &keyword)
 {
-    QString text = html;
+    // Only one search runs at a time; the latest query waits for it
+    if (m_searchFuture.isRunning()) {
+        m_pendingLibrarySearch = keyword;
+        return;
+    }
     
-    // Remove script and style tags with their content
-    text.remove(QRegularExpression("<script[^>]*>.*</script>", QRegularExpression::CaseInsensitiveOption | QRegularExpression::DotMatchesEverythingOption));
-    text.remove(QRegularExpression("<style[^>]*>.*</style>", QRegularExpression::CaseInsensitiveOption | QRegularExpression::DotMatchesEverythingOption));
+    m_tree->clear();
+    QTreeWidgetItem *rootItem = new QTreeWidgetItem(m_tree);
+    rootItem->setText(0, tr("Searching library for \"%1\"...").arg(keyword));
     
-    // Remove HTML tags
-    text.remove(QRegularExpression("<[^>]*>"));
+    // Loading the shards reads every index file, so the search runs in the background
+    auto watcher = new QFutureWatcher<QVector<LibraryHit>>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, keyword]() {
+        QVector<LibraryHit> hits = watcher->result();
+        watcher->deleteLater();
+        
+        if (!m_pendingLibrarySearch.isEmpty()) {
+            QString next = m_pendingLibrarySearch;
+            m_pendingLibrarySearch.clear();
+            if (m_searchLibraryAct->isChecked() && m_currentSearchKeyword == next) {
+                searchLibrary(next);
+                return;
+            }
+        }
+        // Ignore results the user has moved on from
+        if (m_searchLibraryAct->isChecked() && m_currentSearchKeyword == keyword) {
+            showLibraryResults(keyword, hits);
+        }
+        
+        // Shards that could not be read were skipped; rebuild them for the next query
+        if (!m_addFuture.isRunning()) {
+            QStringList stale = m_library->staleArchives();
+            if (!stale.isEmpty()) {
+                indexArchives(stale);
+            }
+        }
+    });
+    
+    Library *library = m_library;
+    m_searchFuture = QtConcurrent::run([library, keyword]() {
+        TRACE_SCOPE("searchLibrary", keyword);
+        return library->search(keyword);
+    });
+    watcher->setFuture(m_searchFuture);
+}
+
+void MainWindow::showLibraryResults(const QString &keyword, const QVector<LibraryHit> &hits)
+{
+    m_tree->clear();
+    
+    QTreeWidgetItem *rootItem = new QTreeWidgetItem(m_tree);
+    rootItem->setExpanded(true);
     
-    // Decode HTML entities
-    text.replace("&nbsp;", " ");
-    text.replace("&lt;", "<");
-    text.replace("&gt;", ">");
-    text.replace("&amp;", "&");
-    text.replace("&quot;", "\"");
-    text.replace("&#39;", "'");
+    for (const LibraryHit &hit : hits) {
+        // The archive is only unpacked when the result is activated
+        auto item = new QTreeWidgetItem(rootItem);
+        item->setText(0, QString("[%1] %2 - %3").arg(hit.archiveName, hit.title, hit.summary));
+        item->setToolTip(0, hit.chmPath);
+        item->setData(0, kArchiveRole, hit.chmPath);
+        item->setData(0, kPageRole, hit.path);
+    }
+    
+    rootItem->setText(0, tr("Library Results: \"%1\" (%2 matches)").arg(keyword).arg(hits.size()));
     
-    // Normalize whitespace
-    text = text.simplified();
+    const int stale = m_library->staleArchives().size();
+    if (stale > 0) {
+        auto item = new QTreeWidgetItem(rootItem);
+        item->setText(0, tr("%1 archives are being re-indexed and were not searched").arg(stale));
+        item->setForeground(0, Qt::gray);
+    }
     
-    return text;
+    if (hits.isEmpty()) {
+        auto item = new QTreeWidgetItem(rootItem);
+        item->setText(0, tr("No results found"));
+        item->setForeground(0, Qt::gray);
+    }
 }
 
 void MainWindow::onPageLoaded(bool ok)
 {
+    // Page loads are asynchronous, so their span is recorded from loadStarted to here
+    if (m_pageLoadStartUs >= 0) {
+        Trace::complete("pageLoad", m_pageLoadStartUs, Trace::nowUs() - m_pageLoadStartUs, m_view->url().toString());
+        m_pageLoadStartUs = -1;
+    }
+    
     if (!ok) {
         return;
     }
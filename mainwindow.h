@@ -1,16 +1,26 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include "library.h"
+
 #include <QMainWindow>
+#include <QFuture>
 #include <QSet>
+#include <QStringList>
+#include <QVector>
 
 QT_BEGIN_NAMESPACE
 class QTreeWidget;
 class QWebEngineView;
 class QLineEdit;
 class QPushButton;
+class QTreeWidgetItem;
+class QAction;
 QT_END_NAMESPACE
 
+class PagePrefetcher;
+class ResourceCache;
+
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -26,19 +36,25 @@ private slots:
     void onSearchTextChanged(const QString &text);
     void onPageLoaded(bool ok);
     void onClearSearch();
+    void onSetCacheBudget();
+    void onToggleTrace(bool enabled);
+    void onAddToLibrary();
+    void onRemoveFromLibrary();
+    void onExportSite();
 
 private:
     void createUi();
-    bool unpackChm(const QString &chmPath, const QString &outDir);
+    bool openArchive(const QString &chmPath, bool showToc);
     void buildFileTree(const QString &rootPath);
     void buildTocTree(const QString &hhcPath);
     void addFileToTree(const QString &filePath, const QString &rootPath);
-    QByteArray detectEncoding(const QString &filePath);
-    QString readFileWithEncoding(const QString &filePath, const QByteArray &encoding);
     void fixHtmlEncoding(const QString &htmlPath, const QByteArray &encoding);
+    void prefetchAround(QTreeWidgetItem *item, const QString &path);
     void cleanupTempDir();
     void searchInFiles(const QString &keyword);
-    QString stripHtmlTags(const QString &html);
+    void searchLibrary(const QString &keyword);
+    void showLibraryResults(const QString &keyword, const QVector<LibraryHit> &hits);
+    void indexArchives(const QStringList &chmPaths);
     void highlightKeyword(const QString &keyword);
 
     QTreeWidget *m_tree = nullptr;
@@ -46,10 +62,21 @@ private:
     QLineEdit *m_searchEdit = nullptr;
     QPushButton *m_searchButton = nullptr;
     QPushButton *m_clearSearchButton = nullptr;
+    QAction *m_searchLibraryAct = nullptr;
+    QAction *m_exportAct = nullptr;
+    QAction *m_addLibraryAct = nullptr;
     QString m_tmpDir;
+    QString m_chmPath;  // Archive currently unpacked into m_tmpDir
     QByteArray m_detectedEncoding;
     QSet<QString> m_convertedFiles;  // Track converted files to avoid re-conversion
     QString m_currentSearchKeyword;  // Store current search keyword for highlighting
+    ResourceCache *m_cache = nullptr;  // Decoded pages and search text, bounded by a byte budget
+    PagePrefetcher *m_prefetcher = nullptr;  // Warms the cache with likely next pages
+    Library *m_library = nullptr;  // Registered archives and their index shards
+    QFuture<QStringList> m_addFuture;  // Archives being added in the background
+    QFuture<QVector<LibraryHit>> m_searchFuture;  // Library search in progress, at most one
+    QString m_pendingLibrarySearch;  // Query entered while a library search was running
+    qint64 m_pageLoadStartUs = -1;  // Trace clock at loadStarted, -1 when not tracing
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,173 @@
+#include "pageprefetcher.h"
+#include "htmlcodec.h"
+#include "resourcecache.h"
+#include "trace.h"
+
+#include <QRunnable>
+#include <QThread>
+#include <QRegularExpression>
+#include <QFileInfo>
+#include <QDir>
+#include <QUrl>
+#include <QSet>
+
+namespace
+{
+    const int kMaxLinks = 8;  // Outbound links followed per page
+}
+
+class PrefetchTask : public QRunnable
+{
+public:
+    PrefetchTask(PagePrefetcher *owner, const QString &path, bool followLinks, int epoch)
+        : m_owner(owner), m_path(path), m_followLinks(followLinks), m_epoch(epoch)
+    {
+    }
+
+    void run() override
+    {
+        // Only use otherwise idle CPU (SCHED_IDLE on Linux); the worker shares
+        // no locks with the owner's thread, so it cannot hold it up
+        QThread::currentThread()->setPriority(QThread::IdlePriority);
+
+        if (m_followLinks) {
+            m_owner->loadLinks(m_path, m_epoch);
+        } else {
+            m_owner->load(m_path, m_epoch);
+        }
+    }
+
+private:
+    PagePrefetcher *m_owner;
+    QString m_path;
+    bool m_followLinks;
+    int m_epoch;
+};
+
+PagePrefetcher::PagePrefetcher(ResourceCache *cache, QObject *parent)
+    : QObject(parent)
+    , m_cache(cache)
+{
+    // A single worker is enough to stay ahead of a human reader
+    m_pool.setMaxThreadCount(1);
+}
+
+PagePrefetcher::~PagePrefetcher()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void PagePrefetcher::prefetch(const QStringList &paths, const QString &linkSource)
+{
+    // Predictions for the previous page are stale now
+    m_pool.clear();
+
+    int epoch = m_epoch.load();
+    int priority = paths.size() + 1;
+    for (const QString &path : paths) {
+        if (!m_cache->contains(ResourceCache::Page, path)) {
+            m_pool.start(new PrefetchTask(this, path, false, epoch), priority);
+        }
+        --priority;
+    }
+
+    if (!linkSource.isEmpty()) {
+        m_pool.start(new PrefetchTask(this, linkSource, true, epoch), 0);
+    }
+}
+
+void PagePrefetcher::reset()
+{
+    m_epoch.ref();
+    m_pool.clear();
+}
+
+void PagePrefetcher::load(const QString &path, int epoch)
+{
+    TRACE_SCOPE("prefetch", path);
+
+    if (m_epoch.load() != epoch) {
+        return;
+    }
+
+    QString html = HtmlCodec::transcodeFile(path);
+    if (html.isEmpty()) {
+        return;
+    }
+
+    QMetaObject::invokeMethod(this, "onPageLoaded", Qt::QueuedConnection,
+                              Q_ARG(QString, path), Q_ARG(QString, html), Q_ARG(int, epoch));
+}
+
+void PagePrefetcher::loadLinks(const QString &pagePath, int epoch)
+{
+    if (m_epoch.load() != epoch) {
+        return;
+    }
+
+    QStringList links = extractLinks(HtmlCodec::transcodeFile(pagePath), pagePath);
+    if (links.size() > kMaxLinks) {
+        links.erase(links.begin() + kMaxLinks, links.end());
+    }
+    if (!links.isEmpty()) {
+        QMetaObject::invokeMethod(this, "onLinksFound", Qt::QueuedConnection,
+                                  Q_ARG(QStringList, links), Q_ARG(int, epoch));
+    }
+}
+
+void PagePrefetcher::onPageLoaded(const QString &path, const QString &html, int epoch)
+{
+    // reset() runs on this thread too, so a result decoded for a previous
+    // archive is always recognized here, however late it arrives
+    if (m_epoch.load() != epoch) {
+        return;
+    }
+    m_cache->insert(ResourceCache::Page, path, html);
+}
+
+void PagePrefetcher::onLinksFound(const QStringList &links, int epoch)
+{
+    if (m_epoch.load() != epoch) {
+        return;
+    }
+
+    // Links come after the predicted pages still queued
+    for (const QString &link : links) {
+        if (!m_cache->contains(ResourceCache::Page, link)) {
+            m_pool.start(new PrefetchTask(this, link, false, epoch), 0);
+        }
+    }
+}
+
+QStringList PagePrefetcher::extractLinks(const QString &html, const QString &pagePath)
+{
+    static const QRegularExpression hrefRx("href\\s*=\\s*['\"]([^'\"#]+)",
+                                           QRegularExpression::CaseInsensitiveOption);
+
+    QDir pageDir = QFileInfo(pagePath).dir();
+    QStringList links;
+    QSet<QString> seen;
+
+    QRegularExpressionMatchIterator matchIt = hrefRx.globalMatch(html);
+    while (matchIt.hasNext()) {
+        QString href = matchIt.next().captured(1).trimmed();
+
+        // Skip external and scripted links (http:, mailto:, javascript:, ms-its: ...)
+        if (href.isEmpty() || href.contains(':')) {
+            continue;
+        }
+        if (!href.endsWith(".htm", Qt::CaseInsensitive) && !href.endsWith(".html", Qt::CaseInsensitive)) {
+            continue;
+        }
+
+        QString absPath = QFileInfo(pageDir.filePath(QUrl::fromPercentEncoding(href.toUtf8()))).absoluteFilePath();
+        if (absPath == pagePath || seen.contains(absPath) || !QFileInfo::exists(absPath)) {
+            continue;
+        }
+        seen.insert(absPath);
+        links << absPath;
+    }
+
+    return links;
+}
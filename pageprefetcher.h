@@ -0,0 +1,51 @@
+#ifndef PAGEPREFETCHER_H
+#define PAGEPREFETCHER_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QThreadPool>
+#include <QStringList>
+
+class ResourceCache;
+
+// Background prefetcher that transcodes the pages a reader is likely to open
+// next into the shared resource cache, so activating them skips the disk
+// read, encoding detection and conversion. The worker only decodes; results
+// are inserted into the cache on the owner's thread, so the worker never
+// holds a lock the owner waits for and a reset() cannot be overtaken by a
+// stale result.
+class PagePrefetcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PagePrefetcher(ResourceCache *cache, QObject *parent = nullptr);
+    ~PagePrefetcher();
+
+    // Queue the given pages (most likely first), then the local links of linkSource.
+    // Pending predictions from an earlier call are dropped.
+    void prefetch(const QStringList &paths, const QString &linkSource = QString());
+    // Drop queued work and discard results still in flight, e.g. when another
+    // CHM is opened
+    void reset();
+
+    // Local .htm/.html pages referenced by href attributes in html
+    static QStringList extractLinks(const QString &html, const QString &pagePath);
+
+private slots:
+    void onPageLoaded(const QString &path, const QString &html, int epoch);
+    void onLinksFound(const QStringList &links, int epoch);
+
+private:
+    friend class PrefetchTask;
+
+    // Run on the worker thread
+    void load(const QString &path, int epoch);
+    void loadLinks(const QString &pagePath, int epoch);
+
+    ResourceCache *m_cache;
+    QThreadPool m_pool;
+    QAtomicInt m_epoch;  // Bumped by reset() to discard in-flight results
+};
+
+#endif // PAGEPREFETCHER_H
@@ -0,0 +1,91 @@
+#include "pagesearch.h"
+#include "chmarchive.h"
+#include "htmlcodec.h"
+#include "htmltext.h"
+#include "resourcecache.h"
+#include "trace.h"
+
+#include <QDirIterator>
+#include <QFileInfo>
+
+bool PageSearch::loadPage(const QString &filePath, ResourceCache *cache, QString *title, QString *plainText)
+{
+    // Reuse the stripped text from an earlier search when it is still cached.
+    // The entry holds the page title on the first line and the text after it.
+    QString cached;
+    if (cache && cache->lookup(ResourceCache::Text, filePath, &cached)) {
+        int newline = cached.indexOf('\n');
+        *title = cached.left(newline);
+        *plainText = cached.mid(newline + 1);
+        return true;
+    }
+
+    // Detect encoding for this file
+    QByteArray encoding = HtmlCodec::detectFileEncoding(filePath);
+
+    // Read file content
+    QString content = HtmlCodec::readFile(filePath, encoding);
+    if (content.isNull()) {
+        return false;
+    }
+
+    // Strip HTML tags for searching
+    *plainText = HtmlText::stripTags(content);
+
+    // Extract title from HTML
+    *title = HtmlText::extractTitle(content);
+    if (title->isEmpty()) {
+        *title = QFileInfo(filePath).fileName();
+    }
+
+    if (cache) {
+        cache->insert(ResourceCache::Text, filePath, *title + '\n' + *plainText);
+    }
+    return true;
+}
+
+QVector<SearchHit> PageSearch::search(const QString &rootDir, const QString &keyword, ResourceCache *cache)
+{
+    TRACE_SCOPE("searchPages", keyword);
+    QVector<SearchHit> hits;
+
+    // Search in all HTML files
+    QDirIterator it(rootDir, QStringList() << "*.html" << "*.htm",
+                    QDir::Files, QDirIterator::Subdirectories);
+
+    while (it.hasNext()) {
+        QString filePath = it.next();
+
+        // Skip system files
+        if (ChmArchive::isSystemFile(it.fileName())) {
+            continue;
+        }
+
+        QString title;
+        QString plainText;
+        if (!loadPage(filePath, cache, &title, &plainText)) {
+            continue;
+        }
+
+        // Search for keyword (case insensitive)
+        int pos = plainText.indexOf(keyword, 0, Qt::CaseInsensitive);
+        if (pos == -1) {
+            continue;
+        }
+
+        // Find context around the keyword
+        int contextStart = qMax(0, pos - 50);
+        int contextEnd = qMin(plainText.length(), pos + keyword.length() + 50);
+        QString context = plainText.mid(contextStart, contextEnd - contextStart).trimmed();
+        if (contextStart > 0) context = "..." + context;
+        if (contextEnd < plainText.length()) context = context + "...";
+
+        SearchHit hit;
+        hit.path = filePath;
+        hit.title = title;
+        hit.context = context;
+        hits.append(hit);
+    }
+
+    return hits;
+}
@@ -0,0 +1,26 @@
+#ifndef PAGESEARCH_H
+#define PAGESEARCH_H
+
+#include <QString>
+#include <QVector>
+
+class ResourceCache;
+
+struct SearchHit
+{
+    QString path;
+    QString title;
+    QString context;  // Text around the first match, with "..." where it was cut
+};
+
+// Full-text search over the pages of an unpacked CHM
+namespace PageSearch
+{
+    // Case-insensitive search of every page below rootDir. When a cache is
+    // given, stripped page text is taken from and added to it.
+    QVector<SearchHit> search(const QString &rootDir, const QString &keyword, ResourceCache *cache = nullptr);
+    // Title and tag-stripped text of one page; the title falls back to the file name
+    bool loadPage(const QString &filePath, ResourceCache *cache, QString *title, QString *plainText);
+}
+
+#endif // PAGESEARCH_H
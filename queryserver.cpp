@@ -0,0 +1,531 @@
+#include "queryserver.h"
+#include "chmarchive.h"
+#include "htmlcodec.h"
+#include "library.h"
+#include "searchindex.h"
+#include "trace.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonParseError>
+#include <QList>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QSharedPointer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QVector>
+#include <QtConcurrent/QtConcurrentRun>
+
+namespace
+{
+    // A client that sends more than this without completing a request is dropped
+    const int kMaxRequestBytes = 1024 * 1024;
+    const int kDefaultLimit = 50;
+    const int kMaxLimit = 1000;
+
+    // GET /<method>?a=b&c=d becomes {"method": "<method>", "params": {"a": "b", "c": "d"}}
+    QByteArray httpPayload(const QByteArray &verb, const QByteArray &target, const QByteArray &body)
+    {
+        QUrl url(QString::fromLatin1(target));
+        if (verb == "POST" && url.path() == "/query") {
+            return body;
+        }
+
+        QJsonObject params;
+        for (const auto &item : QUrlQuery(url).queryItems(QUrl::FullyDecoded)) {
+            params[item.first] = item.second;
+        }
+
+        QJsonObject request;
+        request["method"] = url.path().mid(1);
+        request["params"] = params;
+        return QJsonDocument(request).toJson(QJsonDocument::Compact);
+    }
+
+    QByteArray statusText(int status)
+    {
+        switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 503: return "Service Unavailable";
+        default: return "Error";
+        }
+    }
+
+    QByteArray errorReply(int status, const QString &message)
+    {
+        QJsonObject reply;
+        reply["error"] = message;
+        reply["status"] = status;
+        return QJsonDocument(reply).toJson(QJsonDocument::Compact);
+    }
+
+    struct Reply
+    {
+        int status;  // Sent as the HTTP status; the local socket only gets the body
+        QByteArray body;
+    };
+
+    // One client connection. Requests run on the server pool and may finish
+    // in any order; replies are held back until all earlier ones are written.
+    class Connection : public QObject
+    {
+    public:
+        Connection(QueryServer *server, QIODevice *socket, bool http)
+            : QObject(socket)
+            , m_server(server)
+            , m_socket(socket)
+            , m_http(http)
+        {
+            connect(socket, &QIODevice::readyRead, this, [this]() {
+                onReadyRead();
+            });
+        }
+
+    private:
+        void onReadyRead()
+        {
+            if (m_closing) {
+                m_socket->readAll();
+                return;
+            }
+
+            m_buffer += m_socket->readAll();
+            if (m_http) {
+                readHttp();
+            } else {
+                readLines();
+            }
+
+            if (m_buffer.size() > kMaxRequestBytes) {
+                m_buffer.clear();
+                m_closing = true;
+                closeSocket();
+            }
+        }
+
+        // Local socket: one request or batch per line
+        void readLines()
+        {
+            int end;
+            while ((end = m_buffer.indexOf('\n')) != -1) {
+                QByteArray line = m_buffer.left(end).trimmed();
+                m_buffer.remove(0, end + 1);
+                if (!line.isEmpty()) {
+                    dispatch(line);
+                }
+            }
+        }
+
+        // HTTP: one request per connection, answered with Connection: close
+        void readHttp()
+        {
+            int headerEnd = m_buffer.indexOf("\r\n\r\n");
+            if (headerEnd == -1) return;
+
+            QList<QByteArray> lines = m_buffer.left(headerEnd).split('\n');
+            QList<QByteArray> requestLine = lines.takeFirst().trimmed().split(' ');
+            int contentLength = 0;
+            QByteArray host;
+            for (const QByteArray &line : lines) {
+                int colon = line.indexOf(':');
+                if (colon == -1) continue;
+                const QByteArray name = line.left(colon).trimmed().toLower();
+                if (name == "content-length") {
+                    contentLength = line.mid(colon + 1).trimmed().toInt();
+                } else if (name == "host") {
+                    host = line.mid(colon + 1).trimmed().toLower();
+                }
+            }
+            if (m_buffer.size() < headerEnd + 4 + contentLength) return;
+
+            QByteArray body = m_buffer.mid(headerEnd + 4, contentLength);
+            m_buffer.clear();
+            m_closing = true;
+
+            if (requestLine.size() < 2) {
+                write(Reply{400, errorReply(400, "Malformed request line")});
+                return;
+            }
+            // A web page can point its own host name at 127.0.0.1 (DNS rebinding),
+            // so only answer requests that were addressed to this machine by name
+            if (!isLocalHost(host)) {
+                write(Reply{403, errorReply(403, QString("Host \"%1\" is not allowed").arg(QString::fromLatin1(host)))});
+                return;
+            }
+            dispatch(httpPayload(requestLine.at(0), requestLine.at(1), body));
+        }
+
+        bool isLocalHost(const QByteArray &host) const
+        {
+            const QTcpSocket *tcp = qobject_cast<const QTcpSocket *>(m_socket);
+            if (!tcp) return false;
+            const QByteArray port = ':' + QByteArray::number(tcp->localPort());
+            return host == "127.0.0.1" + port || host == "localhost" + port;
+        }
+
+        void dispatch(const QByteArray &payload)
+        {
+            QueryServer *server = m_server;
+            auto *watcher = new QFutureWatcher<Reply>(this);
+            connect(watcher, &QFutureWatcherBase::finished, this, [this]() {
+                flush();
+            });
+            m_pending.append(watcher);
+            watcher->setFuture(QtConcurrent::run(server->pool(), [server, payload]() {
+                int status = 200;
+                QByteArray body = server->handle(payload, &status);
+                return Reply{status, body};
+            }));
+        }
+
+        void flush()
+        {
+            while (!m_pending.isEmpty() && m_pending.first()->isFinished()) {
+                QFutureWatcher<Reply> *watcher = m_pending.takeFirst();
+                write(watcher->result());
+                watcher->deleteLater();
+            }
+        }
+
+        void write(const Reply &reply)
+        {
+            if (!m_http) {
+                m_socket->write(reply.body + '\n');
+                return;
+            }
+
+            // The JSON body carries the error message, as on the local socket
+            QByteArray response = "HTTP/1.1 " + QByteArray::number(reply.status) + ' ' + statusText(reply.status) + "\r\n"
+                                  "Content-Type: application/json; charset=utf-8\r\n"
+                                  "Content-Length: " + QByteArray::number(reply.body.size()) + "\r\n"
+                                  "Connection: close\r\n\r\n";
+            m_socket->write(response + reply.body);
+            closeSocket();
+        }
+
+        // Pending writes are flushed before the connection closes
+        void closeSocket()
+        {
+            if (QTcpSocket *tcp = qobject_cast<QTcpSocket *>(m_socket)) {
+                tcp->disconnectFromHost();
+            } else if (QLocalSocket *local = qobject_cast<QLocalSocket *>(m_socket)) {
+                local->disconnectFromServer();
+            }
+        }
+
+        QueryServer *m_server;
+        QIODevice *m_socket;
+        bool m_http;
+        bool m_closing = false;
+        QByteArray m_buffer;
+        QList<QFutureWatcher<Reply> *> m_pending;
+    };
+}
+
+QueryServer::QueryServer(Library *library, int threads, QObject *parent)
+    : QObject(parent)
+    , m_library(library)
+    , m_localServer(nullptr)
+    , m_httpServer(nullptr)
+{
+    m_pool.setMaxThreadCount(threads > 0 ? threads : QThread::idealThreadCount());
+}
+
+QueryServer::~QueryServer()
+{
+    if (m_localServer) m_localServer->close();
+    if (m_httpServer) m_httpServer->close();
+
+    // Running requests use the library and the page cache
+    m_pool.waitForDone();
+}
+
+bool QueryServer::listenLocal(const QString &name, QString *error)
+{
+    if (!m_localServer) {
+        m_localServer = new QLocalServer(this);
+        connect(m_localServer, &QLocalServer::newConnection, this, &QueryServer::onLocalConnection);
+    }
+
+    // A server that crashed leaves its socket file behind; remove it only if
+    // nothing answers on it
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(1000)) {
+        probe.disconnectFromServer();
+        *error = QString("A server is already running on %1").arg(name);
+        return false;
+    }
+    QLocalServer::removeServer(name);
+
+    if (!m_localServer->listen(name)) {
+        *error = m_localServer->errorString();
+        return false;
+    }
+    return true;
+}
+
+bool QueryServer::listenHttp(quint16 port, QString *error)
+{
+    if (!m_httpServer) {
+        m_httpServer = new QTcpServer(this);
+        connect(m_httpServer, &QTcpServer::newConnection, this, &QueryServer::onHttpConnection);
+    }
+
+    if (!m_httpServer->listen(QHostAddress::LocalHost, port)) {
+        *error = m_httpServer->errorString();
+        return false;
+    }
+    return true;
+}
+
+void QueryServer::onLocalConnection()
+{
+    while (QLocalSocket *socket = m_localServer->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        new Connection(this, socket, false);
+    }
+}
+
+void QueryServer::onHttpConnection()
+{
+    while (QTcpSocket *socket = m_httpServer->nextPendingConnection()) {
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        new Connection(this, socket, true);
+    }
+}
+
+QByteArray QueryServer::handle(const QByteArray &payload, int *status)
+{
+    QJsonParseError parseError;
+    QJsonDocument document = QJsonDocument::fromJson(payload, &parseError);
+    if (parseError.error != QJsonParseError::NoError) {
+        if (status) *status = 400;
+        return errorReply(400, QString("Invalid JSON: %1").arg(parseError.errorString()));
+    }
+
+    QJsonValue reply = document.isArray() ? handle(QJsonValue(document.array()))
+                                          : handle(QJsonValue(document.object()));
+
+    // A batch succeeds as a whole; its parts carry their own status
+    if (status) {
+        *status = reply.isObject() ? reply.toObject().value("status").toInt(200) : 200;
+    }
+
+    QJsonDocument out = reply.isArray() ? QJsonDocument(reply.toArray()) : QJsonDocument(reply.toObject());
+    return out.toJson(QJsonDocument::Compact);
+}
+
+QJsonValue QueryServer::handle(const QJsonValue &request)
+{
+    if (!request.isArray()) {
+        return handleOne(request.toObject());
+    }
+
+    // The parts of a batch run in parallel; waiting on a queued part runs it
+    // on this thread, so a pool full of batches cannot deadlock
+    const QJsonArray requests = request.toArray();
+    QVector<QFuture<QJsonObject>> futures;
+    for (const QJsonValue &value : requests) {
+        const QJsonObject one = value.toObject();
+        futures << QtConcurrent::run(&m_pool, [this, one]() {
+            return handleOne(one);
+        });
+    }
+
+    QJsonArray replies;
+    for (QFuture<QJsonObject> &future : futures) {
+        replies.append(future.result());
+    }
+    return replies;
+}
+
+QJsonObject QueryServer::handleOne(const QJsonObject &request)
+{
+    const QString method = request.value("method").toString();
+    const QJsonObject params = request.value("params").toObject();
+    TRACE_SCOPE("serveRequest", method);
+
+    int status = 200;
+    QString error;
+    QJsonObject result;
+    if (method.isEmpty()) {
+        status = 400;
+        error = QString("Missing method");
+    } else if (method == "archives") {
+        result = archives();
+    } else if (method == "search") {
+        result = search(params);
+    } else if (method == "toc") {
+        result = toc(params, &status, &error);
+    } else if (method == "page") {
+        result = page(params, &status, &error);
+    } else {
+        status = 404;
+        error = QString("Unknown method \"%1\"").arg(method);
+    }
+
+    QJsonObject reply;
+    if (request.contains("id")) {
+        reply["id"] = request.value("id");
+    }
+    if (error.isEmpty()) {
+        reply["result"] = result;
+    } else {
+        reply["error"] = error;
+        reply["status"] = status;
+    }
+    return reply;
+}
+
+QJsonObject QueryServer::archives() const
+{
+    QJsonArray list;
+    for (const QString &chmPath : m_library->archives()) {
+        QJsonObject archive;
+        archive["archive"] = chmPath;
+        archive["name"] = QFileInfo(chmPath).completeBaseName();
+        list.append(archive);
+    }
+
+    QJsonObject result;
+    result["archives"] = list;
+    return result;
+}
+
+QJsonObject QueryServer::search(const QJsonObject &params)
+{
+    // Over HTTP the limit arrives as a string
+    int limit = params.value("limit").toVariant().toInt();
+    if (limit <= 0) limit = kDefaultLimit;
+    limit = qMin(limit, kMaxLimit);
+
+    QJsonArray hits;
+    for (const LibraryHit &hit : m_library->search(params.value("query").toString(), limit)) {
+        QJsonObject item;
+        item["archive"] = hit.chmPath;
+        item["name"] = hit.archiveName;
+        item["path"] = hit.path;
+        item["title"] = hit.title;
+        item["summary"] = hit.summary;
+        item["score"] = hit.score;
+        hits.append(item);
+    }
+
+    QJsonObject result;
+    result["hits"] = hits;
+    return result;
+}
+
+QJsonObject QueryServer::toc(const QJsonObject &params, int *status, QString *error)
+{
+    const QString chmPath = resolveArchive(params.value("archive").toString());
+    if (chmPath.isEmpty()) {
+        *status = 404;
+        *error = QString("Unknown archive \"%1\"").arg(params.value("archive").toString());
+        return QJsonObject();
+    }
+
+    // The table of contents is stored in the index shard, already in memory
+    QSharedPointer<SearchIndex> index = m_library->shard(chmPath);
+    if (!index) {
+        // Stale shards are rebuilt at startup; one that failed stays unavailable
+        *status = 503;
+        *error = QString("Cannot read the index of %1").arg(chmPath);
+        return QJsonObject();
+    }
+
+    QJsonArray entries;
+    for (const TocEntry &entry : index->toc()) {
+        QJsonObject item;
+        item["name"] = entry.name;
+        item["path"] = entry.path;
+        item["parent"] = entry.parent;
+        entries.append(item);
+    }
+
+    QJsonObject result;
+    result["archive"] = chmPath;
+    result["entries"] = entries;
+    return result;
+}
+
+QJsonObject QueryServer::page(const QJsonObject &params, int *status, QString *error)
+{
+    const QString chmPath = resolveArchive(params.value("archive").toString());
+    if (chmPath.isEmpty()) {
+        *status = 404;
+        *error = QString("Unknown archive \"%1\"").arg(params.value("archive").toString());
+        return QJsonObject();
+    }
+
+    const QString path = QDir::cleanPath(params.value("path").toString());
+    if (path.isEmpty() || path == "." || path.startsWith("..") || QDir::isAbsolutePath(path)
+        || path.startsWith('-') || path.contains('*') || path.contains('?')) {
+        *status = 400;
+        *error = QString("Invalid page path \"%1\"").arg(params.value("path").toString());
+        return QJsonObject();
+    }
+
+    QJsonObject result;
+    result["archive"] = chmPath;
+    result["path"] = path;
+
+    // Pages are cached transcoded; images and other resources as raw bytes
+    const QString key = chmPath + '|' + path;
+    const bool isPage = ChmArchive::isPage(path);
+    QString html;
+    QByteArray data;
+    bool cached = isPage ? m_cache.lookup(ResourceCache::Page, key, &html)
+                         : m_cache.lookup(ResourceCache::Resource, key, &data);
+
+    if (!cached) {
+        if (!ChmArchive::extractFile(chmPath, path, &data)) {
+            *status = 404;
+            *error = QString("Cannot extract %1 from %2").arg(path, chmPath);
+            return QJsonObject();
+        }
+        if (isPage) {
+            html = HtmlCodec::transcode(data);
+            m_cache.insert(ResourceCache::Page, key, html);
+        } else {
+            m_cache.insert(ResourceCache::Resource, key, data);
+        }
+    }
+
+    if (isPage) {
+        result["encoding"] = "utf-8";
+        result["content"] = html;
+    } else {
+        result["encoding"] = "base64";
+        result["content"] = QString::fromLatin1(data.toBase64());
+    }
+    return result;
+}
+
+QString QueryServer::resolveArchive(const QString &name) const
+{
+    if (name.isEmpty()) return QString();
+
+    const QStringList paths = m_library->archives();
+    if (paths.contains(name)) {
+        return name;
+    }
+    for (const QString &chmPath : paths) {
+        if (QFileInfo(chmPath).completeBaseName() == name) {
+            return chmPath;
+        }
+    }
+    return QString();
+}
@@ -0,0 +1,75 @@
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+#include "resourcecache.h"
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+
+class Library;
+class QLocalServer;
+class QTcpServer;
+
+// Headless front end to a Library for other local processes. Requests are
+// JSON objects {"id", "method", "params"}; a JSON array of requests is a
+// batch and gets an array of replies. Methods:
+//   archives                       registered CHM paths
+//   search  {query, limit}         ranked hits across all archives
+//   toc     {archive}              table of contents of one archive
+//   page    {archive, path}        one page, transcoded to UTF-8
+// On the local socket every request and reply is one line of JSON. Over
+// HTTP, POST /query takes the same JSON body, and GET /search, /toc, /page
+// and /archives take the params as query items. A failed request gets
+// {"error", "status"}, where status is the HTTP status sent for it: 400 for
+// a malformed request, 404 for an unknown method, archive or page. HTTP
+// requests must name 127.0.0.1:<port> or localhost:<port> as Host, so web
+// pages cannot reach the server through DNS rebinding.
+// Requests run on a thread pool, so slow page fetches do not hold up
+// searches; replies on one connection keep the order of the requests.
+class QueryServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    // threads <= 0 uses one thread per core
+    explicit QueryServer(Library *library, int threads = 0, QObject *parent = nullptr);
+    ~QueryServer();
+
+    // Unix domain socket (named pipe on Windows); fails if another server answers
+    // on the name, and replaces the socket file only when it is stale
+    bool listenLocal(const QString &name, QString *error);
+    // HTTP on 127.0.0.1 only
+    bool listenHttp(quint16 port, QString *error);
+
+    QThreadPool *pool() { return &m_pool; }
+
+    // Parse and answer one request or batch; safe to call from any thread.
+    // status receives the HTTP status for the reply, 200 for any batch
+    QByteArray handle(const QByteArray &payload, int *status = nullptr);
+    QJsonValue handle(const QJsonValue &request);
+
+private slots:
+    void onLocalConnection();
+    void onHttpConnection();
+
+private:
+    QJsonObject handleOne(const QJsonObject &request);
+    QJsonObject archives() const;
+    QJsonObject search(const QJsonObject &params);
+    QJsonObject toc(const QJsonObject &params, int *status, QString *error);
+    QJsonObject page(const QJsonObject &params, int *status, QString *error);
+    // Registered CHM path for a full path or a base name, or an empty string
+    QString resolveArchive(const QString &name) const;
+
+    Library *m_library;
+    ResourceCache m_cache;  // Extracted pages and resources
+    QThreadPool m_pool;
+    QLocalServer *m_localServer;
+    QTcpServer *m_httpServer;
+};
+
+#endif // QUERYSERVER_H
@@ -0,0 +1,185 @@
+#include "resourcecache.h"
+
+#include <QMutexLocker>
+
+const qint64 ResourceCache::DefaultBudget;
+
+ResourceCache::ResourceCache(qint64 budgetBytes)
+    : m_budget(budgetBytes)
+{
+}
+
+void ResourceCache::setBudget(qint64 budgetBytes)
+{
+    m_budget.store(budgetBytes);
+
+    // Shrink right away instead of waiting for the next insert
+    const qint64 limit = budgetBytes / kShardCount;
+    for (Shard &shard : m_shards) {
+        QMutexLocker locker(&shard.mutex);
+        evict(shard, limit);
+    }
+}
+
+qint64 ResourceCache::budget() const
+{
+    return m_budget.load();
+}
+
+bool ResourceCache::lookup(Type type, const QString &key, QString *value)
+{
+    return lookupEntry(type, key, value, nullptr);
+}
+
+bool ResourceCache::lookup(Type type, const QString &key, QByteArray *data)
+{
+    return lookupEntry(type, key, nullptr, data);
+}
+
+bool ResourceCache::lookupEntry(Type type, const QString &key, QString *value, QByteArray *data)
+{
+    const Key k(type, key);
+    Shard &shard = shardFor(k);
+    QMutexLocker locker(&shard.mutex);
+
+    auto it = shard.index.constFind(k);
+    if (it == shard.index.constEnd()) {
+        shard.stats[type].misses++;
+        return false;
+    }
+
+    // Move to the front of the LRU list
+    shard.lru.splice(shard.lru.begin(), shard.lru, it.value());
+    shard.stats[type].hits++;
+    if (value) *value = it.value()->value;
+    if (data) *data = it.value()->data;
+    return true;
+}
+
+bool ResourceCache::contains(Type type, const QString &key)
+{
+    const Key k(type, key);
+    Shard &shard = shardFor(k);
+    QMutexLocker locker(&shard.mutex);
+    return shard.index.contains(k);
+}
+
+void ResourceCache::insert(Type type, const QString &key, const QString &value)
+{
+    insertEntry(type, key, value, QByteArray());
+}
+
+void ResourceCache::insert(Type type, const QString &key, const QByteArray &data)
+{
+    insertEntry(type, key, QString(), data);
+}
+
+void ResourceCache::insertEntry(Type type, const QString &key, const QString &value, const QByteArray &data)
+{
+    const Key k(type, key);
+    const qint64 bytes = qint64(key.size() + value.size()) * qint64(sizeof(QChar)) + data.size();
+    const qint64 limit = m_budget.load() / kShardCount;
+
+    Shard &shard = shardFor(k);
+    QMutexLocker locker(&shard.mutex);
+
+    // Entries that would not fit in a shard are not worth evicting everything for
+    if (bytes > limit) {
+        shard.stats[type].rejected++;
+        return;
+    }
+
+    auto it = shard.index.find(k);
+    if (it != shard.index.end()) {
+        Entry &entry = *it.value();
+        shard.bytes -= entry.bytes;
+        shard.stats[type].residentBytes -= entry.bytes;
+        entry.value = value;
+        entry.data = data;
+        entry.bytes = bytes;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it.value());
+    } else {
+        shard.lru.push_front(Entry{k, value, data, bytes});
+        shard.index.insert(k, shard.lru.begin());
+        shard.stats[type].entries++;
+    }
+
+    shard.bytes += bytes;
+    shard.stats[type].residentBytes += bytes;
+    evict(shard, limit);
+}
+
+void ResourceCache::clear()
+{
+    for (Shard &shard : m_shards) {
+        QMutexLocker locker(&shard.mutex);
+        shard.lru.clear();
+        shard.index.clear();
+        shard.bytes = 0;
+        for (Stats &stats : shard.stats) {
+            stats.residentBytes = 0;
+            stats.entries = 0;
+        }
+    }
+}
+
+ResourceCache::Stats ResourceCache::stats(Type type) const
+{
+    Stats total;
+    for (const Shard &shard : m_shards) {
+        QMutexLocker locker(&shard.mutex);
+        const Stats &stats = shard.stats[type];
+        total.hits += stats.hits;
+        total.misses += stats.misses;
+        total.evictions += stats.evictions;
+        total.rejected += stats.rejected;
+        total.residentBytes += stats.residentBytes;
+        total.entries += stats.entries;
+    }
+    return total;
+}
+
+ResourceCache::Stats ResourceCache::totalStats() const
+{
+    Stats total;
+    for (int type = 0; type < TypeCount; ++type) {
+        Stats stats = this->stats(Type(type));
+        total.hits += stats.hits;
+        total.misses += stats.misses;
+        total.evictions += stats.evictions;
+        total.rejected += stats.rejected;
+        total.residentBytes += stats.residentBytes;
+        total.entries += stats.entries;
+    }
+    return total;
+}
+
+QString ResourceCache::typeName(Type type)
+{
+    switch (type) {
+    case Page: return QStringLiteral("Pages");
+    case Text: return QStringLiteral("Search text");
+    case Resource: return QStringLiteral("Images and files");
+    default: return QString();
+    }
+}
+
+ResourceCache::Shard &ResourceCache::shardFor(const Key &key)
+{
+    return m_shards[qHash(key) % kShardCount];
+}
+
+void ResourceCache::evict(Shard &shard, qint64 limit)
+{
+    // Drop least recently used entries until the shard is back under budget
+    while (shard.bytes > limit && !shard.lru.empty()) {
+        const Entry &entry = shard.lru.back();
+        Stats &stats = shard.stats[entry.key.first];
+        stats.residentBytes -= entry.bytes;
+        stats.entries--;
+        stats.evictions++;
+        shard.bytes -= entry.bytes;
+        shard.index.remove(entry.key);
+        shard.lru.pop_back();
+    }
+}
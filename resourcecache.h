@@ -0,0 +1,82 @@
+#ifndef RESOURCECACHE_H
+#define RESOURCECACHE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+#include <QPair>
+#include <QMutex>
+#include <QAtomicInteger>
+
+#include <list>
+
+// Byte-budgeted LRU cache for decoded resources, shared between the GUI
+// thread and background workers. Entries are spread over independently
+// locked shards so lookups from different threads rarely contend.
+class ResourceCache
+{
+public:
+    enum Type {
+        Page,   // Transcoded UTF-8 HTML
+        Text,       // Title and tag-stripped text used by search
+        Resource,   // Images and other binary files, kept as raw bytes
+        TypeCount
+    };
+
+    struct Stats {
+        qint64 hits = 0;
+        qint64 misses = 0;
+        qint64 evictions = 0;
+        qint64 rejected = 0;  // Inserts larger than a shard's share of the budget
+        qint64 residentBytes = 0;
+        qint64 entries = 0;
+    };
+
+    static const qint64 DefaultBudget = 64 * 1024 * 1024;
+
+    explicit ResourceCache(qint64 budgetBytes = DefaultBudget);
+
+    void setBudget(qint64 budgetBytes);
+    qint64 budget() const;
+
+    bool lookup(Type type, const QString &key, QString *value);
+    bool lookup(Type type, const QString &key, QByteArray *data);
+    bool contains(Type type, const QString &key);
+    void insert(Type type, const QString &key, const QString &value);
+    void insert(Type type, const QString &key, const QByteArray &data);
+    void clear();
+
+    Stats stats(Type type) const;
+    Stats totalStats() const;
+    static QString typeName(Type type);
+
+private:
+    static const int kShardCount = 8;
+
+    typedef QPair<int, QString> Key;
+
+    struct Entry {
+        Key key;
+        QString value;    // Text types
+        QByteArray data;  // Resource
+        qint64 bytes;
+    };
+
+    struct Shard {
+        mutable QMutex mutex;
+        std::list<Entry> lru;  // Most recently used at the front
+        QHash<Key, std::list<Entry>::iterator> index;
+        qint64 bytes = 0;
+        Stats stats[TypeCount];
+    };
+
+    bool lookupEntry(Type type, const QString &key, QString *value, QByteArray *data);
+    void insertEntry(Type type, const QString &key, const QString &value, const QByteArray &data);
+    Shard &shardFor(const Key &key);
+    void evict(Shard &shard, qint64 limit);
+
+    Shard m_shards[kShardCount];
+    QAtomicInteger<qint64> m_budget;
+};
+
+#endif // RESOURCECACHE_H
@@ -0,0 +1,298 @@
+#include "searchindex.h"
+#include "chmarchive.h"
+#include "pagesearch.h"
+#include "trace.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const quint32 kShardMagic = 0x43484d49;  // "CHMI"
+    const quint32 kShardVersion = 2;  // 2: CJK unigrams are indexed
+    const int kSummaryChars = 160;
+
+    bool isCjk(ushort ucs)
+    {
+        return (ucs >= 0x4E00 && ucs <= 0x9FFF)   // CJK unified ideographs
+            || (ucs >= 0x3400 && ucs <= 0x4DBF)   // Extension A
+            || (ucs >= 0xF900 && ucs <= 0xFAFF)   // Compatibility ideographs
+            || (ucs >= 0x3040 && ucs <= 0x30FF)   // Hiragana and katakana
+            || (ucs >= 0xAC00 && ucs <= 0xD7AF);  // Hangul syllables
+    }
+
+    bool lessDoc(const SearchIndex::Posting &posting, int doc)
+    {
+        return posting.doc < doc;
+    }
+
+    // Term frequency of doc in a sorted posting list, 0 when absent
+    int termFrequency(const SearchIndex::PostingList &list, int doc)
+    {
+        auto it = std::lower_bound(list.constBegin(), list.constEnd(), doc, lessDoc);
+        return (it != list.constEnd() && it->doc == doc) ? it->termFrequency : 0;
+    }
+}
+
+void SearchIndex::build(const QString &rootDir)
+{
+    TRACE_SCOPE("buildIndex", rootDir);
+
+    m_documents.clear();
+    m_toc.clear();
+    m_postings.clear();
+
+    QDir root(rootDir);
+    QStringList pages;
+    QDirIterator it(rootDir, QStringList() << "*.html" << "*.htm", QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QString path = it.next();
+        if (!ChmArchive::isSystemFile(it.fileName())) {
+            pages << path;
+        }
+    }
+    pages.sort();
+
+    for (const QString &page : pages) {
+        QString title;
+        QString plainText;
+        if (!PageSearch::loadPage(page, nullptr, &title, &plainText)) {
+            continue;
+        }
+
+        // Documents are added in id order, so every posting list stays sorted
+        int doc = m_documents.size();
+        m_documents.append(Document{root.relativeFilePath(page), title, plainText.left(kSummaryChars)});
+
+        QHash<QString, int> frequencies;
+        for (const QString &token : tokenize(plainText, Index)) {
+            frequencies[token]++;
+        }
+        for (auto freq = frequencies.constBegin(); freq != frequencies.constEnd(); ++freq) {
+            m_postings[freq.key()].append(Posting{doc, freq.value()});
+        }
+    }
+
+    QString hhcPath = ChmArchive::findToc(rootDir);
+    if (!hhcPath.isEmpty()) {
+        m_toc = TocParser::parseFile(hhcPath);
+        for (TocEntry &entry : m_toc) {
+            if (!entry.path.isEmpty()) {
+                entry.path = root.relativeFilePath(entry.path);
+            }
+        }
+    }
+}
+
+bool SearchIndex::save(const QString &shardPath) const
+{
+    QSaveFile file(shardPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << kShardMagic << kShardVersion;
+
+    out << qint32(m_documents.size());
+    for (const Document &document : m_documents) {
+        out << document.path << document.title << document.summary;
+    }
+
+    out << qint32(m_toc.size());
+    for (const TocEntry &entry : m_toc) {
+        out << entry.name << entry.path << qint32(entry.parent);
+    }
+
+    out << qint32(m_postings.size());
+    for (auto it = m_postings.constBegin(); it != m_postings.constEnd(); ++it) {
+        out << it.key() << qint32(it.value().size());
+        for (const Posting &posting : it.value()) {
+            out << qint32(posting.doc) << qint32(posting.termFrequency);
+        }
+    }
+
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+bool SearchIndex::load(const QString &shardPath)
+{
+    TRACE_SCOPE("loadShard", shardPath);
+
+    QFile file(shardPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    in >> magic >> version;
+    if (magic != kShardMagic || version != kShardVersion) {
+        return false;
+    }
+
+    qint32 count = 0;
+    in >> count;
+    m_documents.resize(qMax(0, count));
+    for (Document &document : m_documents) {
+        in >> document.path >> document.title >> document.summary;
+    }
+
+    in >> count;
+    m_toc.resize(qMax(0, count));
+    for (TocEntry &entry : m_toc) {
+        qint32 parent = -1;
+        in >> entry.name >> entry.path >> parent;
+        entry.parent = parent;
+    }
+
+    in >> count;
+    m_postings.clear();
+    m_postings.reserve(count);
+    for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString term;
+        qint32 size = 0;
+        in >> term >> size;
+        PostingList &list = m_postings[term];
+        list.resize(qMax(0, size));
+        for (Posting &posting : list) {
+            qint32 doc = 0;
+            qint32 frequency = 0;
+            in >> doc >> frequency;
+            posting.doc = doc;
+            posting.termFrequency = frequency;
+        }
+    }
+
+    return in.status() == QDataStream::Ok;
+}
+
+QVector<int> SearchIndex::documentFrequencies(const QStringList &terms) const
+{
+    QVector<int> frequencies;
+    frequencies.reserve(terms.size());
+    for (const QString &term : terms) {
+        frequencies << m_postings.value(term).size();
+    }
+    return frequencies;
+}
+
+QVector<SearchIndex::Match> SearchIndex::search(const QStringList &terms, const QVector<int> &globalFrequencies,
+                                                int globalDocuments) const
+{
+    QVector<Match> matches;
+    if (terms.isEmpty()) {
+        return matches;
+    }
+
+    QVector<const PostingList *> lists;
+    for (const QString &term : terms) {
+        auto it = m_postings.constFind(term);
+        if (it == m_postings.constEnd()) {
+            return matches;  // A term missing from this shard rules out every document
+        }
+        lists << &it.value();
+    }
+
+    for (int doc : intersect(lists)) {
+        double score = 0.0;
+        for (int i = 0; i < lists.size(); ++i) {
+            int frequency = termFrequency(*lists.at(i), doc);
+            double idf = std::log(1.0 + double(globalDocuments) / qMax(1, globalFrequencies.value(i)));
+            score += (1.0 + std::log(double(frequency))) * idf;
+        }
+        matches.append(Match{doc, score});
+    }
+
+    return matches;
+}
+
+QStringList SearchIndex::tokenize(const QString &text, TokenizeMode mode)
+{
+    QStringList tokens;
+    QString word;
+    QString cjkRun;
+
+    auto flushWord = [&]() {
+        if (!word.isEmpty()) {
+            tokens << word;
+            word.clear();
+        }
+    };
+    auto flushCjk = [&]() {
+        // CJK text has no spaces, so index every pair of adjacent characters
+        if (cjkRun.size() == 1) {
+            tokens << cjkRun;
+        } else {
+            for (int i = 0; i + 1 < cjkRun.size(); ++i) {
+                tokens << cjkRun.mid(i, 2);
+            }
+            if (mode == Index) {
+                for (const QChar c : cjkRun) {
+                    tokens << QString(c);
+                }
+            }
+        }
+        cjkRun.clear();
+    };
+
+    for (const QChar c : text) {
+        if (isCjk(c.unicode())) {
+            flushWord();
+            cjkRun += c;
+        } else if (c.isLetterOrNumber() || c == '_') {
+            flushCjk();
+            word += c.toLower();
+        } else {
+            flushWord();
+            flushCjk();
+        }
+    }
+    flushWord();
+    flushCjk();
+
+    return tokens;
+}
+
+QVector<int> SearchIndex::intersect(QVector<const PostingList *> lists)
+{
+    QVector<int> result;
+    if (lists.isEmpty()) {
+        return result;
+    }
+
+    // Start from the shortest list so every step can only shrink the candidate set
+    std::sort(lists.begin(), lists.end(), [](const PostingList *a, const PostingList *b) {
+        return a->size() < b->size();
+    });
+
+    result.reserve(lists.first()->size());
+    for (const Posting &posting : *lists.first()) {
+        result << posting.doc;
+    }
+
+    for (int i = 1; i < lists.size() && !result.isEmpty(); ++i) {
+        const PostingList &list = *lists.at(i);
+        auto pos = list.constBegin();
+        QVector<int> kept;
+        for (int doc : result) {
+            // Binary search forward from the previous hit; candidates are sorted too
+            pos = std::lower_bound(pos, list.constEnd(), doc, lessDoc);
+            if (pos == list.constEnd()) break;
+            if (pos->doc == doc) kept << doc;
+        }
+        result.swap(kept);
+    }
+
+    return result;
+}
@@ -0,0 +1,70 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include "tocparser.h"
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Inverted index over the pages of one unpacked CHM, persisted as a shard
+// file so an archive can be searched without unpacking it again. Paths are
+// stored relative to the archive root.
+class SearchIndex
+{
+public:
+    struct Document
+    {
+        QString path;
+        QString title;
+        QString summary;  // Start of the page text, shown with search results
+    };
+
+    struct Posting
+    {
+        int doc;
+        int termFrequency;
+    };
+
+    typedef QVector<Posting> PostingList;
+
+    enum TokenizeMode {
+        Query,  // Bigrams only, a lone CJK character as itself
+        Index   // Also every CJK character, so one-character queries match
+    };
+
+    struct Match
+    {
+        int doc;
+        double score;
+    };
+
+    // Index every page below rootDir, plus its table of contents
+    void build(const QString &rootDir);
+    bool save(const QString &shardPath) const;
+    bool load(const QString &shardPath);
+
+    int documentCount() const { return m_documents.size(); }
+    const Document &document(int doc) const { return m_documents.at(doc); }
+    const QVector<TocEntry> &toc() const { return m_toc; }
+
+    // Number of documents containing each term, for global idf across shards
+    QVector<int> documentFrequencies(const QStringList &terms) const;
+    // Documents containing all terms, scored by tf-idf using the given
+    // collection-wide statistics
+    QVector<Match> search(const QStringList &terms, const QVector<int> &globalFrequencies,
+                          int globalDocuments) const;
+
+    // Lowercased words for Latin text and overlapping bigrams for CJK text
+    static QStringList tokenize(const QString &text, TokenizeMode mode = Query);
+    // Sorted document ids present in every list
+    static QVector<int> intersect(QVector<const PostingList *> lists);
+
+private:
+    QVector<Document> m_documents;
+    QVector<TocEntry> m_toc;
+    QHash<QString, PostingList> m_postings;
+};
+
+#endif // SEARCHINDEX_H
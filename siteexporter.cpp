@@ -0,0 +1,257 @@
+#include "siteexporter.h"
+#include "chmarchive.h"
+#include "htmlcodec.h"
+#include "trace.h"
+
+#include <QAtomicInt>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QStringList>
+#include <QtConcurrent/QtConcurrentMap>
+
+namespace
+{
+    // Transcode and relink one page in place
+    bool exportPage(const QString &pagePath, const QString &rootDir)
+    {
+        TRACE_SCOPE("exportPage", pagePath);
+
+        QFile in(pagePath);
+        if (!in.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+        QByteArray data = in.readAll();
+        in.close();
+
+        QString html = SiteExporter::rewriteLinks(HtmlCodec::transcode(data), pagePath, rootDir);
+
+        QSaveFile out(pagePath);
+        if (!out.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        out.write(html.toUtf8());
+        return out.commit();
+    }
+
+    // #SYSTEM, $FIftiMain, $WWKeywordLinks/ ... mean nothing outside a CHM viewer
+    void removeSystemFiles(const QString &rootDir)
+    {
+        QDir root(rootDir);
+        for (const QString &name : root.entryList(QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot | QDir::Hidden)) {
+            if (!ChmArchive::isSystemFile(name)) continue;
+            QFileInfo info(root.filePath(name));
+            if (info.isDir()) {
+                QDir(info.filePath()).removeRecursively();
+            } else {
+                QFile::remove(info.filePath());
+            }
+        }
+    }
+
+    // A failed export leaves the directory as it was found, so it can be retried
+    void discardOutput(const QString &rootDir, bool existed)
+    {
+        QDir root(rootDir);
+        root.removeRecursively();
+        if (existed) {
+            QDir().mkpath(rootDir);
+        }
+    }
+
+    bool writeFile(const QString &path, const QString &content)
+    {
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        file.write(content.toUtf8());
+        return file.commit();
+    }
+}
+
+bool SiteExporter::exportSite(const QString &chmPath, const QString &outDir, Result *result, QString *error)
+{
+    TRACE_SCOPE("exportSite", chmPath);
+
+    const QString root = QFileInfo(outDir).absoluteFilePath();
+
+    // Every file below root is rewritten or removed, so only ever work in a
+    // directory that holds nothing but the unpacked archive
+    QDir existing(root);
+    const bool existed = existing.exists();
+    if (existed
+        && !existing.entryList(QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot).isEmpty()) {
+        *error = QString("%1 is not empty; export into a new or empty directory.").arg(root);
+        return false;
+    }
+    if (!QDir().mkpath(root)) {
+        *error = QString("Cannot create %1.").arg(root);
+        return false;
+    }
+
+    // 7z streams the archive straight to disk; export runs in the background,
+    // so it is given as long as the archive needs
+    if (!ChmArchive::unpack(chmPath, root, -1)) {
+        discardOutput(root, existed);
+        *error = QString("Failed to unpack %1. Ensure p7zip (7z) is installed.").arg(chmPath);
+        return false;
+    }
+    removeSystemFiles(root);
+
+    // The .hhc keeps its original encoding, so parse it before anything is rewritten
+    QVector<TocEntry> toc;
+    QString hhcPath = ChmArchive::findToc(root);
+    if (!hhcPath.isEmpty()) {
+        toc = TocParser::parseFile(hhcPath);
+    }
+
+    // Only the paths are held in memory; each worker loads one page at a time
+    QStringList pages;
+    QDirIterator it(root, QStringList() << "*.html" << "*.htm", QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        pages << it.next();
+    }
+    pages.sort();
+
+    QAtomicInt failed;
+    QtConcurrent::blockingMap(pages, [&root, &failed](const QString &page) {
+        if (!exportPage(page, root)) {
+            failed.ref();
+        }
+    });
+
+    // Without a table of contents, list the pages by path
+    if (toc.isEmpty()) {
+        for (const QString &page : pages) {
+            TocEntry entry;
+            entry.name = QDir(root).relativeFilePath(page);
+            entry.path = page;
+            toc.append(entry);
+        }
+    }
+
+    // Never replace a page of the archive that is itself called index.html
+    QString indexPath = QDir(root).filePath("index.html");
+    if (QFile::exists(indexPath)) {
+        indexPath = QDir(root).filePath("chm-index.html");
+    }
+
+    if (!writeFile(indexPath, tocToHtml(toc, QFileInfo(chmPath).completeBaseName(), root))) {
+        discardOutput(root, existed);
+        *error = QString("Cannot write %1.").arg(indexPath);
+        return false;
+    }
+
+    result->pages = pages.size();
+    result->failed = failed.load();
+    result->indexPath = indexPath;
+    return true;
+}
+
+QString SiteExporter::rewriteLinks(const QString &html, const QString &pagePath, const QString &rootDir)
+{
+    static const QRegularExpression linkRx("\\b((?:href|src)\\s*=\\s*)([\"'])(.*?)\\2",
+                                           QRegularExpression::CaseInsensitiveOption);
+    // ms-its:file.chm::/path, mk:@MSITStore:C:\dir\file.chm::/path, its:file.chm::/path
+    static const QRegularExpression itsRx("^(?:ms-its|mk:@msitstore|its):.*?::/?(.*)$",
+                                          QRegularExpression::CaseInsensitiveOption);
+
+    const QDir pageDir = QFileInfo(pagePath).absoluteDir();
+    const QDir root(rootDir);
+
+    QString out;
+    out.reserve(html.size());
+    int last = 0;
+
+    QRegularExpressionMatchIterator it = linkRx.globalMatch(html);
+    while (it.hasNext()) {
+        QRegularExpressionMatch match = it.next();
+        const QString target = match.captured(3);
+
+        // Path relative to the archive root
+        QString inArchive;
+        QRegularExpressionMatch its = itsRx.match(target);
+        if (its.hasMatch()) {
+            inArchive = its.captured(1);
+        } else if (target.startsWith('/') && !target.startsWith("//")) {
+            inArchive = target.mid(1);
+        } else {
+            continue;
+        }
+
+        QString fragment;
+        int hash = inArchive.indexOf('#');
+        if (hash != -1) {
+            fragment = inArchive.mid(hash);
+            inArchive.truncate(hash);
+        }
+
+        out += html.midRef(last, match.capturedStart(3) - last);
+        if (!inArchive.isEmpty()) {
+            out += pageDir.relativeFilePath(root.absoluteFilePath(inArchive));
+        }
+        out += fragment;
+        last = match.capturedEnd(3);
+    }
+    out += html.midRef(last);
+
+    return out;
+}
+
+QString SiteExporter::tocToHtml(const QVector<TocEntry> &toc, const QString &title, const QString &indexDir)
+{
+    const QDir dir(indexDir);
+
+    QString html;
+    html += "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n";
+    html += "<title>" + title.toHtmlEscaped() + "</title>\n</head>\n<body>\n";
+    html += "<h1>" + title.toHtmlEscaped() + "</h1>\n";
+
+    // Entries come in document order with each parent before its children,
+    // so the nesting depth is enough to open and close the lists
+    QVector<int> depths(toc.size(), 0);
+    int depth = -1;
+    for (int i = 0; i < toc.size(); ++i) {
+        const TocEntry &entry = toc.at(i);
+        if (entry.parent >= 0 && entry.parent < i) {
+            depths[i] = depths.at(entry.parent) + 1;
+        }
+
+        if (depths.at(i) > depth) {
+            while (depth < depths.at(i)) {
+                html += "<ul>\n";
+                ++depth;
+            }
+        } else {
+            html += "</li>\n";
+            while (depth > depths.at(i)) {
+                html += "</ul>\n</li>\n";
+                --depth;
+            }
+        }
+
+        html += "<li>";
+        if (entry.path.isEmpty()) {
+            html += entry.name.toHtmlEscaped();
+        } else {
+            html += "<a href=\"" + dir.relativeFilePath(entry.path).toHtmlEscaped() + "\">"
+                  + entry.name.toHtmlEscaped() + "</a>";
+        }
+    }
+
+    if (depth >= 0) {
+        html += "</li>\n";
+        while (depth > 0) {
+            html += "</ul>\n</li>\n";
+            --depth;
+        }
+        html += "</ul>\n";
+    }
+
+    html += "</body>\n</html>\n";
+    return html;
+}
@@ -0,0 +1,33 @@
+#ifndef SITEEXPORTER_H
+#define SITEEXPORTER_H
+
+#include "tocparser.h"
+
+#include <QString>
+#include <QVector>
+
+// Conversion of a CHM archive into a static UTF-8 website: the archive is
+// unpacked into the output directory, every page is transcoded and has its
+// CHM-internal links rewritten in place, and an index page is generated
+// from the table of contents. Pages are converted in parallel, one page per
+// worker at a time, so memory use does not grow with the archive.
+namespace SiteExporter
+{
+    struct Result
+    {
+        int pages = 0;
+        int failed = 0;     // Pages that could not be read or written
+        QString indexPath;  // Generated index page
+    };
+
+    // outDir must be empty or not exist yet; a non-empty directory is refused
+    bool exportSite(const QString &chmPath, const QString &outDir, Result *result, QString *error);
+
+    // Turn ms-its:, mk:@MSITStore: and root-relative links into paths
+    // relative to the page, so the site works from any location
+    QString rewriteLinks(const QString &html, const QString &pagePath, const QString &rootDir);
+    // Nested list of the table of contents, linking relative to indexDir
+    QString tocToHtml(const QVector<TocEntry> &toc, const QString &title, const QString &indexDir);
+}
+
+#endif // SITEEXPORTER_H
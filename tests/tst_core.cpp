@@ -0,0 +1,327 @@
+// Unit tests for the core library: tokenizing and ranking, link rewriting
+// and table of contents output of the site exporter, link discovery of the
+// prefetcher, and the accounting of the resource cache.
+
+#include "pageprefetcher.h"
+#include "resourcecache.h"
+#include "searchindex.h"
+#include "siteexporter.h"
+
+#include <QDir>
+#include <QFile>
+#include <QPair>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include <cmath>
+
+namespace
+{
+    void writeFile(const QString &path, const QByteArray &content)
+    {
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        file.write(content);
+    }
+
+    QByteArray page(const QString &title, const QString &body)
+    {
+        return QString("<html><head><meta charset=\"utf-8\"><title>%1</title></head>"
+                       "<body><p>%2</p></body></html>").arg(title, body).toUtf8();
+    }
+
+    // Keys that land in the same cache shard, mirroring ResourceCache::shardFor
+    QStringList sameShardKeys(ResourceCache::Type type, int count)
+    {
+        QStringList keys;
+        uint shard = 0;
+        for (int i = 0; keys.size() < count; ++i) {
+            const QString key = QString("k%1").arg(i, 4, 10, QChar('0'));
+            if (i == 0) {
+                shard = qHash(qMakePair(int(type), key)) % 8;
+            }
+            if (qHash(qMakePair(int(type), key)) % 8 == shard) {
+                keys << key;
+            }
+        }
+        return keys;
+    }
+
+    SearchIndex::PostingList postings(const QVector<int> &docs)
+    {
+        SearchIndex::PostingList list;
+        for (int doc : docs) {
+            list.append(SearchIndex::Posting{doc, 1});
+        }
+        return list;
+    }
+}
+
+class TestCore : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void tokenizeLatinAndCjk();
+    void singleCjkCharacterMatches();
+    void globalIdfRanking();
+    void intersectPostings();
+    void rewriteLinks_data();
+    void rewriteLinks();
+    void tocToHtmlNesting();
+    void extractLinks();
+    void cacheEvictsLeastRecentlyUsed();
+    void cacheCountsBytesAndRejects();
+};
+
+void TestCore::tokenizeLatinAndCjk()
+{
+    const QString text = QString::fromUtf8("Timer_1 中断处理, DMA");
+
+    QCOMPARE(SearchIndex::tokenize(text),
+             QStringList() << "timer_1" << QString::fromUtf8("中断") << QString::fromUtf8("断处")
+                           << QString::fromUtf8("处理") << "dma");
+
+    // Indexing also stores every CJK character on its own
+    QCOMPARE(SearchIndex::tokenize(text, SearchIndex::Index),
+             QStringList() << "timer_1" << QString::fromUtf8("中断") << QString::fromUtf8("断处")
+                           << QString::fromUtf8("处理") << QString::fromUtf8("中") << QString::fromUtf8("断")
+                           << QString::fromUtf8("处") << QString::fromUtf8("理") << "dma");
+
+    QCOMPARE(SearchIndex::tokenize(QString::fromUtf8("中")), QStringList() << QString::fromUtf8("中"));
+}
+
+void TestCore::singleCjkCharacterMatches()
+{
+    QTemporaryDir root;
+    QVERIFY(root.isValid());
+    writeFile(root.filePath("a.html"), page("A", QString::fromUtf8("定时器中断处理")));
+    writeFile(root.filePath("b.html"), page("B", QString::fromUtf8("时钟配置")));
+
+    SearchIndex index;
+    index.build(root.path());
+    QCOMPARE(index.documentCount(), 2);
+
+    auto matches = [&index](const QString &query) {
+        const QStringList terms = SearchIndex::tokenize(query);
+        QStringList paths;
+        for (const SearchIndex::Match &match : index.search(terms, index.documentFrequencies(terms),
+                                                            index.documentCount())) {
+            paths << index.document(match.doc).path;
+        }
+        return paths;
+    };
+
+    QCOMPARE(matches(QString::fromUtf8("中")), QStringList() << "a.html");
+    QCOMPARE(matches(QString::fromUtf8("时")), QStringList() << "a.html" << "b.html");
+    QCOMPARE(matches(QString::fromUtf8("中断")), QStringList() << "a.html");
+    QCOMPARE(matches(QString::fromUtf8("断中")), QStringList());
+}
+
+void TestCore::globalIdfRanking()
+{
+    // "timer" is rare in the first shard but common in the second; scores
+    // must use the document frequencies of both
+    QTemporaryDir first;
+    QTemporaryDir second;
+    QVERIFY(first.isValid() && second.isValid());
+    writeFile(first.filePath("a1.html"), page("A1", "timer timer timer"));
+    writeFile(first.filePath("a2.html"), page("A2", "clock"));
+    writeFile(second.filePath("b1.html"), page("B1", "timer clock"));
+    writeFile(second.filePath("b2.html"), page("B2", "timer"));
+    writeFile(second.filePath("b3.html"), page("B3", "clock"));
+
+    SearchIndex shardA;
+    SearchIndex shardB;
+    shardA.build(first.path());
+    shardB.build(second.path());
+
+    const QStringList terms = SearchIndex::tokenize("timer");
+    QVector<int> frequencies = shardA.documentFrequencies(terms);
+    frequencies[0] += shardB.documentFrequencies(terms).at(0);
+    const int documents = shardA.documentCount() + shardB.documentCount();
+    QCOMPARE(frequencies.at(0), 3);
+    QCOMPARE(documents, 5);
+
+    const QVector<SearchIndex::Match> hitsA = shardA.search(terms, frequencies, documents);
+    const QVector<SearchIndex::Match> hitsB = shardB.search(terms, frequencies, documents);
+    QCOMPARE(hitsA.size(), 1);
+    QCOMPARE(hitsB.size(), 2);
+
+    const double idf = std::log(1.0 + 5.0 / 3.0);
+    QCOMPARE(hitsA.at(0).score, (1.0 + std::log(3.0)) * idf);
+    QCOMPARE(hitsB.at(0).score, idf);
+    QVERIFY(hitsA.at(0).score > hitsB.at(0).score);
+}
+
+void TestCore::intersectPostings()
+{
+    const SearchIndex::PostingList a = postings({1, 3, 5, 7, 9});
+    const SearchIndex::PostingList b = postings({3, 5, 9, 11});
+    const SearchIndex::PostingList c = postings({0, 3, 9});
+    const SearchIndex::PostingList empty;
+
+    QCOMPARE(SearchIndex::intersect({&a, &b, &c}), QVector<int>({3, 9}));
+    QCOMPARE(SearchIndex::intersect({&a}), QVector<int>({1, 3, 5, 7, 9}));
+    QCOMPARE(SearchIndex::intersect({&a, &empty}), QVector<int>());
+    QCOMPARE(SearchIndex::intersect({}), QVector<int>());
+}
+
+void TestCore::rewriteLinks_data()
+{
+    QTest::addColumn<QString>("html");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("ms-its") << "<a href=\"ms-its:manual.chm::/sub/other.html#sec\">"
+                            << "<a href=\"other.html#sec\">";
+    QTest::newRow("ms-its without slash") << "<a href='MS-ITS:manual.chm::index.html'>"
+                                          << "<a href='../index.html'>";
+    QTest::newRow("mk:@MSITStore") << "<img src=\"mk:@MSITStore:C:\\docs\\manual.chm::/images/a.png\">"
+                                   << "<img src=\"../images/a.png\">";
+    QTest::newRow("root-relative") << "<a href=\"/index.html#top\">"
+                                   << "<a href=\"../index.html#top\">";
+    QTest::newRow("fragment only") << "<a href=\"ms-its:manual.chm::/#intro\">"
+                                   << "<a href=\"#intro\">";
+    QTest::newRow("relative unchanged") << "<a href=\"other.html#sec\">"
+                                        << "<a href=\"other.html#sec\">";
+    QTest::newRow("external unchanged") << "<a href=\"http://example.com/x.html\"><script src=\"//cdn.example.com/x.js\">"
+                                        << "<a href=\"http://example.com/x.html\"><script src=\"//cdn.example.com/x.js\">";
+}
+
+void TestCore::rewriteLinks()
+{
+    QFETCH(QString, html);
+    QFETCH(QString, expected);
+
+    const QString root = QDir::cleanPath(QDir::tempPath() + "/site");
+    QCOMPARE(SiteExporter::rewriteLinks(html, root + "/sub/page.html", root), expected);
+}
+
+void TestCore::tocToHtmlNesting()
+{
+    const QString root = QDir::cleanPath(QDir::tempPath() + "/site");
+
+    QVector<TocEntry> toc;
+    auto add = [&toc](const QString &name, const QString &path, int parent) {
+        TocEntry entry;
+        entry.name = name;
+        entry.path = path;
+        entry.parent = parent;
+        toc.append(entry);
+    };
+    add("Chapter 1", root + "/c1.html", -1);
+    add("Section 1.1", root + "/s11.html", 0);
+    add("Section 1.1.1 & more", root + "/s111.html", 1);
+    add("Chapter 2", QString(), -1);
+
+    const QString html = SiteExporter::tocToHtml(toc, "Manual <v2>", root);
+
+    QVERIFY(html.contains("<h1>Manual &lt;v2&gt;</h1>"));
+    QVERIFY(html.contains("<ul>\n"
+                          "<li><a href=\"c1.html\">Chapter 1</a><ul>\n"
+                          "<li><a href=\"s11.html\">Section 1.1</a><ul>\n"
+                          "<li><a href=\"s111.html\">Section 1.1.1 &amp; more</a></li>\n"
+                          "</ul>\n</li>\n"
+                          "</ul>\n</li>\n"
+                          "<li>Chapter 2</li>\n"
+                          "</ul>\n"));
+    QCOMPARE(html.count("<ul>"), html.count("</ul>"));
+    QCOMPARE(html.count("<li>"), html.count("</li>"));
+
+    QVERIFY(!SiteExporter::tocToHtml(QVector<TocEntry>(), "Empty", root).contains("<ul>"));
+}
+
+void TestCore::extractLinks()
+{
+    QTemporaryDir root;
+    QVERIFY(root.isValid());
+    const QString pagePath = QDir(root.path()).absoluteFilePath("a.html");
+    writeFile(pagePath, QByteArray());
+    writeFile(root.filePath("b.html"), QByteArray());
+    writeFile(root.filePath("sub/c.htm"), QByteArray());
+
+    const QString html = "<a href=\"b.html\"> <a href='sub/c.htm#part'> <a href=\"a.html\">"
+                         "<a href=\"http://example.com/d.html\"> <a href=\"missing.html\">"
+                         "<link href=\"style.css\"> <a href=\"B.html\"> <a href=\"b.html\">";
+
+    QStringList expected;
+    expected << QDir(root.path()).absoluteFilePath("b.html")
+             << QDir(root.path()).absoluteFilePath("sub/c.htm");
+    QStringList links = PagePrefetcher::extractLinks(html, pagePath);
+    // B.html only exists on case-insensitive file systems
+    links.removeAll(QDir(root.path()).absoluteFilePath("B.html"));
+    QCOMPARE(links, expected);
+}
+
+void TestCore::cacheEvictsLeastRecentlyUsed()
+{
+    // Each entry is (5 + 100) * 2 bytes, and a shard holds two of them
+    const qint64 entryBytes = (5 + 100) * 2;
+    ResourceCache cache(8 * (2 * entryBytes + 10));
+    const QStringList keys = sameShardKeys(ResourceCache::Page, 3);
+
+    const QString value(100, QChar('x'));
+    cache.insert(ResourceCache::Page, keys.at(0), value);
+    cache.insert(ResourceCache::Page, keys.at(1), value);
+
+    // Touching the first entry makes the second the least recently used
+    QString out;
+    QVERIFY(cache.lookup(ResourceCache::Page, keys.at(0), &out));
+    QCOMPARE(out, value);
+    cache.insert(ResourceCache::Page, keys.at(2), value);
+
+    QVERIFY(cache.contains(ResourceCache::Page, keys.at(0)));
+    QVERIFY(!cache.contains(ResourceCache::Page, keys.at(1)));
+    QVERIFY(cache.contains(ResourceCache::Page, keys.at(2)));
+
+    const ResourceCache::Stats stats = cache.stats(ResourceCache::Page);
+    QCOMPARE(stats.entries, qint64(2));
+    QCOMPARE(stats.evictions, qint64(1));
+    QCOMPARE(stats.residentBytes, 2 * entryBytes);
+    QCOMPARE(stats.hits, qint64(1));
+
+    // Shrinking the budget evicts immediately
+    cache.setBudget(8 * entryBytes);
+    QCOMPARE(cache.stats(ResourceCache::Page).entries, qint64(1));
+    QCOMPARE(cache.stats(ResourceCache::Page).residentBytes, entryBytes);
+}
+
+void TestCore::cacheCountsBytesAndRejects()
+{
+    ResourceCache cache(8 * 1000);
+
+    cache.insert(ResourceCache::Text, "text", QString("abcdef"));
+    cache.insert(ResourceCache::Resource, "image.png", QByteArray(100, '\0'));
+
+    QCOMPARE(cache.stats(ResourceCache::Text).residentBytes, qint64((4 + 6) * 2));
+    QCOMPARE(cache.stats(ResourceCache::Resource).residentBytes, qint64(9 * 2 + 100));
+
+    // Replacing an entry replaces its bytes
+    cache.insert(ResourceCache::Text, "text", QString("ab"));
+    QCOMPARE(cache.stats(ResourceCache::Text).residentBytes, qint64((4 + 2) * 2));
+    QCOMPARE(cache.stats(ResourceCache::Text).entries, qint64(1));
+
+    // Binary data comes back unchanged and a text lookup of the same key misses
+    QByteArray data;
+    QVERIFY(cache.lookup(ResourceCache::Resource, "image.png", &data));
+    QCOMPARE(data, QByteArray(100, '\0'));
+    QString text;
+    QVERIFY(!cache.lookup(ResourceCache::Text, "image.png", &text));
+    QCOMPARE(cache.stats(ResourceCache::Text).misses, qint64(1));
+
+    // Larger than a shard's share of the budget: counted, not stored
+    cache.insert(ResourceCache::Resource, "huge.bin", QByteArray(1001, '\0'));
+    QVERIFY(!cache.contains(ResourceCache::Resource, "huge.bin"));
+    QCOMPARE(cache.stats(ResourceCache::Resource).rejected, qint64(1));
+    QCOMPARE(cache.totalStats().entries, qint64(2));
+    QCOMPARE(cache.totalStats().residentBytes, qint64((4 + 2) * 2 + 9 * 2 + 100));
+
+    cache.clear();
+    QCOMPARE(cache.totalStats().entries, qint64(0));
+    QCOMPARE(cache.totalStats().residentBytes, qint64(0));
+}
+
+QTEST_GUILESS_MAIN(TestCore)
+
+#include "tst_core.moc"
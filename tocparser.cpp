@@ -0,0 +1,123 @@
+#include "tocparser.h"
+#include "htmlcodec.h"
+#include "trace.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QStack>
+
+QVector<TocEntry> TocParser::parse(const QString &content, const QString &baseDir)
+{
+    QVector<TocEntry> entries;
+    QDir dir(baseDir);
+
+    // Parse HTML-like .hhc file
+    // .hhc files contain nested <UL> and <LI> with <OBJECT> containing <param> tags
+    QStack<int> parentStack;
+    parentStack.push(-1); // Root level
+
+    static const QRegularExpression ulStart("<\\s*ul\\s*>", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression ulEnd("</\\s*ul\\s*>", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression liStart("<\\s*li\\s*>", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression paramRx("<\\s*param\\s+name\\s*=\\s*\"([^\"]+)\"\\s+value\\s*=\\s*\"([^\"]+)\"",
+                                            QRegularExpression::CaseInsensitiveOption);
+
+    int pos = 0;
+    QString currentName;
+    QString currentLocal;
+
+    while (pos < content.length()) {
+        // Find next tag
+        int ulStartPos = content.indexOf(ulStart, pos);
+        int ulEndPos = content.indexOf(ulEnd, pos);
+        int liStartPos = content.indexOf(liStart, pos);
+
+        // Determine which comes first
+        int nextPos = content.length();
+        enum TagType { UL_START, UL_END, LI_START, NONE } nextTag = NONE;
+
+        if (ulStartPos != -1 && ulStartPos < nextPos) { nextPos = ulStartPos; nextTag = UL_START; }
+        if (ulEndPos != -1 && ulEndPos < nextPos) { nextPos = ulEndPos; nextTag = UL_END; }
+        if (liStartPos != -1 && liStartPos < nextPos) { nextPos = liStartPos; nextTag = LI_START; }
+
+        if (nextTag == NONE) break;
+
+        if (nextTag == UL_START) {
+            // Nothing to do, just move forward
+            pos = nextPos + 4;
+        } else if (nextTag == UL_END) {
+            // Pop from stack
+            if (parentStack.size() > 1) {
+                parentStack.pop();
+            }
+            pos = nextPos + 5;
+        } else if (nextTag == LI_START) {
+            // Extract parameters until next </object> or next <li>
+            int objEnd = content.indexOf("</object>", nextPos, Qt::CaseInsensitive);
+            if (objEnd == -1) objEnd = content.indexOf("<li>", nextPos + 4, Qt::CaseInsensitive);
+            if (objEnd == -1) objEnd = content.length();
+
+            QString objContent = content.mid(nextPos, objEnd - nextPos);
+
+            // Extract name and local parameters
+            currentName.clear();
+            currentLocal.clear();
+
+            QRegularExpressionMatchIterator matchIt = paramRx.globalMatch(objContent);
+            while (matchIt.hasNext()) {
+                QRegularExpressionMatch match = matchIt.next();
+                QString paramName = match.captured(1).toLower();
+                QString paramValue = match.captured(2);
+
+                if (paramName == "name") {
+                    currentName = paramValue;
+                } else if (paramName == "local") {
+                    currentLocal = paramValue;
+                }
+            }
+
+            // Create an entry if we have a name
+            if (!currentName.isEmpty()) {
+                TocEntry entry;
+                entry.name = currentName;
+                entry.parent = parentStack.top();
+
+                // Resolve local path relative to .hhc location
+                if (!currentLocal.isEmpty()) {
+                    entry.path = QFileInfo(dir.filePath(currentLocal)).absoluteFilePath();
+                }
+
+                entries.append(entry);
+
+                // Check if next is <ul> (has children)
+                int nextUlPos = content.indexOf(ulStart, objEnd);
+                int nextLiPos = content.indexOf(liStart, objEnd);
+                int nextUlEndPos = content.indexOf(ulEnd, objEnd);
+
+                if (nextUlPos != -1 && (nextLiPos == -1 || nextUlPos < nextLiPos) && (nextUlEndPos == -1 || nextUlPos < nextUlEndPos)) {
+                    // This entry has children, push it to stack
+                    parentStack.push(entries.size() - 1);
+                }
+            }
+
+            pos = objEnd;
+        }
+    }
+
+    return entries;
+}
+
+QVector<TocEntry> TocParser::parseFile(const QString &hhcPath)
+{
+    TRACE_SCOPE("parseToc", hhcPath);
+
+    // Detect encoding
+    QByteArray encoding = HtmlCodec::detectFileEncoding(hhcPath);
+    QString content = HtmlCodec::readFile(hhcPath, encoding);
+    if (content.isEmpty()) {
+        return QVector<TocEntry>();
+    }
+
+    return parse(content, QFileInfo(hhcPath).absolutePath());
+}
@@ -0,0 +1,24 @@
+#ifndef TOCPARSER_H
+#define TOCPARSER_H
+
+#include <QString>
+#include <QVector>
+
+// One entry of a parsed .hhc table of contents. Entries are stored flat in
+// document order; parent is the index of the enclosing entry or -1.
+struct TocEntry
+{
+    QString name;
+    QString path;  // Absolute path of the page, empty for pure headings
+    int parent = -1;
+};
+
+namespace TocParser
+{
+    // Parse the content of a .hhc file; local paths are resolved against baseDir
+    QVector<TocEntry> parse(const QString &content, const QString &baseDir);
+    // Read a .hhc file with its detected encoding and parse it
+    QVector<TocEntry> parseFile(const QString &hhcPath);
+}
+
+#endif // TOCPARSER_H
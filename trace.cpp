@@ -0,0 +1,159 @@
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QSharedPointer>
+#include <QThread>
+#include <QVector>
+
+QAtomicInt Trace::g_enabled(0);
+
+namespace
+{
+    struct Event
+    {
+        const char *name;
+        qint64 startUs;
+        qint64 durationUs;
+        QString detail;
+    };
+
+    // Owned by the registry rather than the thread so spans survive thread exit
+    struct ThreadBuffer
+    {
+        QMutex mutex;  // Only contended while a trace is being written
+        QVector<Event> events;
+        int tid = 0;
+        QString threadName;
+    };
+
+    QMutex g_registryMutex;
+    QVector<QSharedPointer<ThreadBuffer>> g_buffers;
+    QAtomicInt g_nextTid(0);
+
+    thread_local ThreadBuffer *t_buffer = nullptr;
+
+    QElapsedTimer startedTimer()
+    {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }
+
+    const QElapsedTimer &traceClock()
+    {
+        static const QElapsedTimer timer = startedTimer();
+        return timer;
+    }
+
+    ThreadBuffer *threadBuffer()
+    {
+        if (t_buffer) {
+            return t_buffer;
+        }
+
+        QSharedPointer<ThreadBuffer> buffer(new ThreadBuffer);
+        buffer->tid = g_nextTid.fetchAndAddRelaxed(1) + 1;
+
+        QThread *thread = QThread::currentThread();
+        QCoreApplication *app = QCoreApplication::instance();
+        if (!thread->objectName().isEmpty()) {
+            buffer->threadName = thread->objectName();
+        } else if (app && thread == app->thread()) {
+            buffer->threadName = "main";
+        } else {
+            buffer->threadName = QString("worker %1").arg(buffer->tid);
+        }
+
+        QMutexLocker locker(&g_registryMutex);
+        g_buffers.append(buffer);
+        t_buffer = buffer.data();
+        return t_buffer;
+    }
+}
+
+void Trace::setEnabled(bool enabled)
+{
+    // Start the clock before the first span so timestamps are never negative
+    traceClock();
+    g_enabled.storeRelease(enabled ? 1 : 0);
+}
+
+qint64 Trace::nowUs()
+{
+    return traceClock().nsecsElapsed() / 1000;
+}
+
+void Trace::complete(const char *name, qint64 startUs, qint64 durationUs, const QString &detail)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    ThreadBuffer *buffer = threadBuffer();
+    QMutexLocker locker(&buffer->mutex);
+    buffer->events.append(Event{name, startUs, durationUs, detail});
+}
+
+void Trace::clear()
+{
+    QMutexLocker registryLocker(&g_registryMutex);
+    for (const QSharedPointer<ThreadBuffer> &buffer : g_buffers) {
+        QMutexLocker locker(&buffer->mutex);
+        buffer->events.clear();
+    }
+}
+
+bool Trace::writeChromeJson(const QString &path)
+{
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray events;
+
+    {
+        QMutexLocker registryLocker(&g_registryMutex);
+        for (const QSharedPointer<ThreadBuffer> &buffer : g_buffers) {
+            QMutexLocker locker(&buffer->mutex);
+
+            // Metadata event so the viewer shows readable thread names
+            QJsonObject threadName;
+            threadName["name"] = "thread_name";
+            threadName["ph"] = "M";
+            threadName["pid"] = double(pid);
+            threadName["tid"] = buffer->tid;
+            threadName["args"] = QJsonObject{{"name", buffer->threadName}};
+            events.append(threadName);
+
+            for (const Event &event : buffer->events) {
+                QJsonObject json;
+                json["name"] = QString::fromLatin1(event.name);
+                json["cat"] = "chmreader";
+                json["ph"] = "X";
+                json["ts"] = double(event.startUs);
+                json["dur"] = double(event.durationUs);
+                json["pid"] = double(pid);
+                json["tid"] = buffer->tid;
+                if (!event.detail.isEmpty()) {
+                    json["args"] = QJsonObject{{"detail", event.detail}};
+                }
+                events.append(json);
+            }
+        }
+    }
+
+    QJsonObject root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ms";
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
@@ -0,0 +1,60 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QAtomicInt>
+#include <QString>
+
+// Lightweight span tracing exported in the Chrome trace-event format, which
+// chrome://tracing and ui.perfetto.dev can open. Each thread records into its
+// own buffer; when tracing is disabled a span costs one atomic load.
+namespace Trace
+{
+    extern QAtomicInt g_enabled;
+
+    inline bool isEnabled()
+    {
+        return g_enabled.loadAcquire() != 0;
+    }
+
+    void setEnabled(bool enabled);
+    // Microseconds since the first use of the trace clock
+    qint64 nowUs();
+    // Record a finished span; name must be a string literal
+    void complete(const char *name, qint64 startUs, qint64 durationUs, const QString &detail = QString());
+    // Drop everything recorded so far
+    void clear();
+    // Write all recorded spans as Chrome trace JSON
+    bool writeChromeJson(const QString &path);
+
+    // Records the lifetime of the enclosing scope as a span
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name, const QString &detail = QString())
+            : m_name(name), m_startUs(isEnabled() ? nowUs() : -1)
+        {
+            if (m_startUs >= 0) m_detail = detail;
+        }
+
+        ~Scope()
+        {
+            if (m_startUs >= 0) {
+                complete(m_name, m_startUs, nowUs() - m_startUs, m_detail);
+            }
+        }
+
+    private:
+        Q_DISABLE_COPY(Scope)
+
+        const char *m_name;
+        qint64 m_startUs;
+        QString m_detail;
+    };
+}
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+// TRACE_SCOPE("name") or TRACE_SCOPE("name", detail) traces the rest of the block
+#define TRACE_SCOPE(...) Trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(__VA_ARGS__)
+
+#endif // TRACE_H